@@ -25,66 +25,126 @@ the user can start several lighting programs or turn the LEDs to a specific hue
 
 // The pins that the LED strips are plugged into as a
 // multi-dimensional array of [shelves][color]
-LEDFader shelves[SHELVES][RGB] = {
-    // Red         Green        Blue
-    LEDFader(4), LEDFader(3), LEDFader(2),   // Shelf 1 (top)
-    LEDFader(5), LEDFader(7), LEDFader(6),   // Shelf 2
-    LEDFader(8), LEDFader(9), LEDFader(10),  // Shelf 3
-    LEDFader(11), LEDFader(12), LEDFader(13) // Shelf 4 (bottom)
+const uint8_t shelf_pins[SHELVES][RGB] = {
+    // Red Green Blue
+    { 4,  3,  2 },  // Shelf 1 (top)
+    { 5,  7,  6 },  // Shelf 2
+    { 8,  9,  10 }, // Shelf 3
+    { 11, 12, 13 }  // Shelf 4 (bottom)
 };
 
-// True if any shelves are currently fading
-bool is_fading = false;
+// All the shelf LEDs, faded together as SHELVES groups of RGB channels
+FaderBank<SHELVES, RGB, ShelfCurve, SHELF_QUEUE, TimerOutput> shelves(&shelf_pins[0][0]);
 
-// Proximity sensor range state
-int distance = 0;          // current distance
+// FADE_RGB or FADE_HUE
+byte fade_mode = FADE_RGB;
+
+// Proximity sensor on Serial2
+MaxSonar sonar(Serial2);
+DistanceFilter distance_filter(DISTANCE_MEDIAN, DISTANCE_SMOOTHING);
 
 // The last IR code received
 char ir_value = 0;
 
+// Program 3's saved colors
+EEPROMStore<SavedColors> color_store(COLORS_EEPROM_ADDRESS, COLORS_EEPROM_SLOTS, COLORS_SAVE_DELAY);
+
+// Plays keyframe shows on the shelves
+Sequencer sequencer;
+
+// Settings commands on the USB serial port
+Console console(Serial);
+
+// Frames from a PC on the USB serial port, for the stream program
+FrameStream frame_stream(Serial);
+
+// The LED programs. Each one is allocated once, here, and switching programs
+// only calls exit() and enter(), so the heap is never touched.
+Program0 program0;
+Program1 program1;
+Program2 program2;
+Program3 program3;
+Program4 program4;
+
+// The IR code that starts each program, by program number
+struct ProgramEntry {
+  char ir_code;
+  Program *program;
+};
+const ProgramEntry programs[] = {
+  { IR_POWER, &program0 }, // Turn off custom program and go back to the default behavior
+  { IR_A, &program1 },
+  { IR_B, &program2 },
+  { IR_C, &program3 },
+  { 0, &program4 }         // PROGRAM_STREAM, started from the console
+};
+#define PROGRAMS (sizeof(programs) / sizeof(programs[0]))
+
 // The LED program running
-Program* current_program;
+Program* current_program = 0;
 byte current_program_num = 0;
 
 void setup() {
   Serial.begin(115200);
-  Serial.println("Start");
+  logger.begin(Serial);
+  LOG_INFO("Start");
+
+  // The shelf pins without a 16-bit timer (4, 9 and 10) make up the bits they're missing by dithering
+  for (byte ch = 0; ch < SHELVES * RGB; ch++) {
+    shelves.set_dither(ch, true);
+  }
 
   delay(500);
   off();
   delay(500);
 
-  // Add linear fade curve to all LEDs
-  for (int shelf = 0; shelf < SHELVES; shelf++) {
-    for (int rgb = 0; rgb < RGB; rgb++) {
-      shelves[shelf][rgb].set_curve(Curve::linear);
-    }
-  }
-
   // IR receiver
   Serial1.begin(115200);
 
   // Distance sensor
   Serial2.begin(9600);
 
-  // Default program
-  current_program = new Program0();
+  // This installation's settings
+  load_settings();
+  apply_settings();
+
+  // Start where we left off
+  start_program(settings.program);
 }
 
 void loop() {
+  PROFILE_BEGIN(PROFILE_LOOP);
 
-  // Update all LEDs
-  is_fading = false;
-  for (byte shelf = 0; shelf < SHELVES; shelf++) {
-    for(byte rgb = 0; rgb < RGB; rgb++) {
-      if (shelves[shelf][rgb].update()) {
-        is_fading = true;
-      }
-    }
-  }
+  // Update all LEDs, and start the next steps of the show playing
+  PROFILE_BEGIN(PROFILE_FADES);
+  shelves.update(millis());
+  sequencer.update(millis());
+  PROFILE_END(PROFILE_FADES);
 
   // Run program
+  PROFILE_BEGIN(PROFILE_PROGRAM);
   run_program();
+  PROFILE_END(PROFILE_PROGRAM);
+
+  // Settings commands (the stream program has the port to itself)
+  PROFILE_BEGIN(PROFILE_CONSOLE);
+  if (current_program_num != PROGRAM_STREAM) {
+    console.poll();
+  }
+  PROFILE_END(PROFILE_CONSOLE);
+
+  // Write saved settings, a byte at a time
+  PROFILE_BEGIN(PROFILE_EEPROM);
+  color_store.poll(millis());
+  poll_settings(millis());
+  PROFILE_END(PROFILE_EEPROM);
+
+  // Send whatever log output the serial port has room for
+  PROFILE_BEGIN(PROFILE_LOG);
+  logger.drain();
+  PROFILE_END(PROFILE_LOG);
+
+  PROFILE_END(PROFILE_LOOP);
 }
 
 /**
@@ -116,33 +176,20 @@ byte run_program() {
 
   // IR Command received
   if (Serial1.available()) {
-    ir_value = Serial1.read();
-    Serial.println(ir_value);
+    ir_value = TRACE_INPUT(TRACE_IR, Serial1.read());
+    LOG_DEBUG("IR %c", ir_value);
 
     // Start new program
-    switch(ir_value) {
-      case IR_POWER: // Turn off custom program and go back to the default behavior
-        current_program_num = 0;
-        current_program = new Program0();
-      break;
-      case IR_A:
-        current_program_num = 1;
-        current_program = new Program1();
-      break;
-      case IR_B:
-        current_program_num = 2;
-        current_program = new Program2();
-      break;
-      case IR_C:
-        current_program_num = 3;
-        current_program = new Program3();
-      break;
+    for (byte num = 0; num < PROGRAMS; num++) {
+      if (programs[num].ir_code && programs[num].ir_code == ir_value) {
+        start_program(num);
+        break;
+      }
     }
 
     // Program changed
     if (last_prog != current_program_num) {
-      Serial.print("Start program ");
-      Serial.println(current_program_num);
+      LOG_INFO("Start program %u", current_program_num);
     }
 
   } else {
@@ -155,66 +202,67 @@ byte run_program() {
   return current_program_num;
 }
 
-
 /**
- * Get the distance, in mm, from the MaxSonar sensor
- * (code adapted from http://forum.arduino.cc/index.php?topic=130842.0)
+ * Leave the current program and start another one by its number
  */
-int get_distance() {
-  if((char)Serial2.peek() == 'R'){
-    if(Serial2.available() >= 5) {
-      Serial2.read(); // Take R off the top
-      int thousands = (Serial2.read() - '0') * 1000; // Take and convert each range digit to human-readable integer format.
-      int hundreds = (Serial2.read() - '0') * 100;
-      int tens = (Serial2.read() - '0') * 10;
-      int units = (Serial2.read() - '0') * 1;
-      int cr = Serial2.read(); // Don't do anything with this, just clear it out of the buffer with the rest.
-
-      // Assemble the digits into the range integer.
-      distance = thousands + hundreds + tens + units;
-
-      // Something is within range HRLV-EZ1 range is 30cm - 5m
-      //Serial.print("Range (mm): ");
-      //Serial.println(String(distance));
-      return distance;
-    }
+void start_program(byte num) {
+  if (current_program) {
+    current_program->exit();
   }
-  // Take the peeked byte off the top
-  else {
-    Serial2.read();
+  current_program_num = num;
+  current_program = programs[num].program;
+  fade_mode = FADE_RGB;
+  current_program->enter();
+
+  // Come back to it after a power cycle (but not to streaming, which needs the PC)
+  if (num != PROGRAM_STREAM && settings.program != num) {
+    settings.program = num;
+    save_settings();
   }
+}
 
-  // Return the last distance received
-  return distance;
+/**
+ * Put changed settings into effect
+ */
+void apply_settings() {
+  shelves.set_min_interval(settings.min_interval);
+}
+
+
+/**
+ * Get the distance, in mm, from the MaxSonar sensor.
+ * Reads every frame that has arrived on Serial2 and returns the filtered distance.
+ */
+int get_distance() {
+  PROFILE_BEGIN(PROFILE_SONAR);
+  if (sonar.poll() && sonar.get_distance() > MIN_RANGE) {
+    distance_filter.add(sonar.get_distance());
+  }
+  PROFILE_END(PROFILE_SONAR);
+  return distance_filter.get();
 }
 
 /**
  * Turn off all LEDs
  */
 void off() {
-  for (int shelf = 0; shelf < SHELVES; shelf++) {
-    for (int rgb = 0; rgb < RGB; rgb++) {
-      LEDFader *led = &shelves[shelf][rgb];
-      led->stop_fade();
-      led->set_value(0);
-    }
-  }
+  shelves.stop_all();
+  set_all(0, 0, 0);
 }
 
 /**
  * Set the PWM value on a single LED of a shelf
  */
 void set_led(byte shelf, byte led, byte value) {
-  shelves[shelf][led].set_value(value);
+  shelves.set_value(shelf * RGB + led, value);
 }
 
 /**
  * Set the RGB value of a shelf.
  */
 void set_shelf(byte shelf, byte r, byte g, byte b) {
-  shelves[shelf][0].set_value(r);
-  shelves[shelf][1].set_value(g);
-  shelves[shelf][2].set_value(b);
+  const uint8_t values[RGB] = { r, g, b };
+  shelves.set_group(shelf, values);
 }
 
 /**
@@ -226,13 +274,34 @@ void set_all(byte r, byte g, byte b) {
   }
 }
 
+/**
+ * Fade shelves through RGB or hues from now on
+ */
+void set_fade_mode(byte mode) {
+  fade_mode = mode;
+}
+
 /**
  * Fade a shelf to an RGB color
  */
 void fade_shelf(byte shelf, byte r, byte g, byte b, int duration) {
-  shelves[shelf][0].fade((uint8_t)r, duration);
-  shelves[shelf][1].fade((uint8_t)g, duration);
-  shelves[shelf][2].fade((uint8_t)b, duration);
+  const uint8_t values[RGB] = { r, g, b };
+  if (fade_mode == FADE_HUE) {
+    shelves.fade_group_hue(shelf, values, duration);
+  } else {
+    shelves.fade_group(shelf, values, duration);
+  }
+}
+
+/**
+ * Fade a shelf to an RGB color after the fades already started or queued on it
+ */
+bool queue_shelf(byte shelf, byte r, byte g, byte b, int duration) {
+  const uint8_t values[RGB] = { r, g, b };
+  if (fade_mode == FADE_HUE) {
+    return shelves.queue_group_hue(shelf, values, duration);
+  }
+  return shelves.queue_group(shelf, values, duration);
 }
 
 /**
@@ -246,9 +315,14 @@ void fade_all(byte pwm, int duration) {
  * Fade all shelves to the same RGB value.
  */
 void fade_all(byte r, byte g, byte b, int duration) {
-  for (byte shelf = 0; shelf < SHELVES; shelf++) {
-    fade_shelf(shelf, r, g, b, duration);
+  if (fade_mode == FADE_HUE) {
+    for (byte shelf = 0; shelf < SHELVES; shelf++) {
+      fade_shelf(shelf, r, g, b, duration);
+    }
+    return;
   }
+  const uint8_t values[RGB] = { r, g, b };
+  shelves.fade_all(values, duration);
 }
 
 /**
@@ -256,16 +330,11 @@ void fade_all(byte r, byte g, byte b, int duration) {
  * For example, to slow it down by 100 milliseconds, pass -100
  */
 void change_speed(int by) {
-  for (int shelf = 0; shelf < SHELVES; shelf++) {
-    for (int rgb = 0; rgb < RGB; rgb++) {
-
-      if (by < 0) {
-        shelves[shelf][rgb].faster(abs(by));
-      }
-      else {
-        shelves[shelf][rgb].slower(by);
-      }
-    }
+  if (by < 0) {
+    shelves.faster(abs(by));
+  }
+  else {
+    shelves.slower(by);
   }
 }
 
@@ -273,9 +342,26 @@ void change_speed(int by) {
  * Returns true if the shelf is still fading
  */
 bool is_shelf_fading(byte shelf) {
-  return (shelves[shelf][0].is_fading()
-      || shelves[shelf][1].is_fading()
-      || shelves[shelf][2].is_fading());
+  return shelves.is_group_fading(shelf);
+}
+
+/**
+ * Returns true if the shelf's fades finished in this loop()
+ */
+bool is_shelf_finished(byte shelf) {
+  return shelves.is_group_finished(shelf);
+}
+
+/*
+ -------------------------
+ Program
+ By default, programs have nothing to set up or tear down
+ -------------------------
+*/
+void Program::enter() {
+}
+
+void Program::exit() {
 }
 
 /*
@@ -285,12 +371,27 @@ bool is_shelf_fading(byte shelf) {
  fades them down when the person walks away.
  -------------------------
 */
-Program0::Program0() {
-  Serial.println("Init program 0");
+// Distance (mm) to brightness, for follow mode. Straight lines between the points;
+// closer than the first point is full brightness, further than the last is off.
+struct FollowPoint {
+  int distance;
+  byte brightness;
+};
+const FollowPoint follow_curve[] PROGMEM = {
+  { 500, 255 },
+  { CLOSE_RANGE, 160 },
+  { MED_RANGE, 30 },
+  { 1500, 0 }
+};
+#define FOLLOW_POINTS (sizeof(follow_curve) / sizeof(follow_curve[0]))
+
+void Program0::enter() {
+  LOG_INFO("Init program 0");
 
   range_close = false;
   range_medium = false;
   out_range_timer = 0;
+  distance_filter.reset();
 
   // Fade out all LEDs
   fade_all(0, 0, 0, 1000);
@@ -305,22 +406,50 @@ Program0::Program0() {
 void Program0::run() {
   int distance = get_distance();
 
+  // Switch modes
+  if (ir_value == IR_SELECT) {
+    follow = !follow;
+    LOG_INFO("Follow distance: %u", follow);
+
+    // Back to the ranges: start from out of range, and dim if that's where the person is
+    range_close = false;
+    range_medium = false;
+    out_range_timer = millis();
+  }
 
   // Invalid distance, too close to for the sensor
-  if (distance <= 30) {
+  if (distance <= MIN_RANGE) {
     return;
   }
 
-  // Out of range
-  if (distance > MED_RANGE ){
+  // The sensor has gone quiet; don't act on an old reading
+  if (millis() - sonar.get_reading_time() > SONAR_TIMEOUT) {
+    return;
+  }
+
+  // Follow the distance. This runs every loop, but only changes anything when the
+  // filtered distance does, and then only retargets the fade already in progress.
+  if (follow) {
+    byte pwm = follow_brightness(distance);
+    const uint8_t values[RGB] = { pwm, pwm, pwm };
+    shelves.retarget_all(values, FOLLOW_TIME);
+    return;
+  }
+
+  // Out of range (once in range, it takes the hysteresis more to leave)
+  int out_of_range = settings.med_range;
+  if (range_medium || range_close) {
+    out_of_range += settings.hysteresis;
+  }
+  if (distance > out_of_range) {
 
     // If was formerly in range, set timer and dim
     if (range_medium || range_close) {
       range_close = false;
       range_medium = false;
-      Serial.println("Went out of range...");
+      LOG_INFO("Went out of range...");
 
-      out_range_timer = millis() + OUT_OF_RANGE_DELAY;
+      out_range_timer = millis() + settings.out_of_range_delay;
 
       // Handle when value wraps back to zero (just add 1 for simplicity)
       if (out_range_timer == 0) {
@@ -330,107 +459,102 @@ void Program0::run() {
 
     // Timer set and fired, fade out
     else if(out_range_timer > 0 && out_range_timer <= millis()) {
-      Serial.println("Dim lights");
+      LOG_INFO("Dim lights");
       out_range_timer = 0;
-      fade_all(0, FADE_SPEED);
+      fade_all(0, settings.fade_speed);
     }
   }
 
   // Close range
-  if (!range_close && distance <= CLOSE_RANGE) {
-    Serial.print("Close range: ");
-    Serial.println(distance);
+  if (!range_close && distance <= (int)settings.close_range) {
+    LOG_INFO("Close range: %d", distance);
     range_close = true;
     range_medium = true;
     out_range_timer = 0;
-    fade_all(255, FADE_SPEED);
+    fade_all(255, settings.fade_speed);
   }
 
   // Medium range
-  else if (!range_medium && distance <= MED_RANGE) {
-    Serial.print("Medium range: ");
-    Serial.println(distance);
+  else if (!range_medium && distance <= (int)settings.med_range) {
+    LOG_INFO("Medium range: %d", distance);
     range_close = false;
     range_medium = true;
     out_range_timer = 0;
-    fade_all(30, FADE_SPEED);
+    fade_all(30, settings.fade_speed);
   }
 }
 
+byte Program0::follow_brightness(int distance) {
+  FollowPoint a, b;
+  memcpy_P(&a, &follow_curve[0], sizeof(a));
+  if (distance <= a.distance) {
+    return a.brightness;
+  }
+
+  for (byte i = 1; i < FOLLOW_POINTS; i++) {
+    memcpy_P(&b, &follow_curve[i], sizeof(b));
+    if (distance <= b.distance) {
+      long span = b.distance - a.distance;
+      long into = distance - a.distance;
+      return a.brightness + ((long)b.brightness - a.brightness) * into / span;
+    }
+    a = b;
+  }
+  return a.brightness;
+}
+
 /*
  -------------------------
  Program 1
  Fade a random color up/down on each shelf independent of all other shelves
  -------------------------
 */
-Program1::Program1() {
-  Serial.println("Init program 1");
+void Program1::enter() {
+  LOG_INFO("Init program 1");
   off();
   randomSeed(analogRead(0));
 
-  for (int i = 0; i < SHELVES; i++) {
-    direction[i] = 0;
-    duration[i] = 0;
+  for (byte s = 0; s < SHELVES; s++) {
+    start_shelf(s);
   }
 }
 
 // The main part of the program, run once each loop() cycle
-void Program1::run() {
+void Program1::start_shelf(byte s) {
 
-  // Loop over the shelves and set colors when their done fading
-  for (byte s = 0; s < SHELVES; s++) {
+  // Generate random pwm on two colors
+  byte colors[3] = {0,0,0};
+  for(byte i = 0; i < 2; i++) {
+    byte rgb = random(0, 3);
+
+    // First color (100 - 256)
+    if (i == 0) {
+      colors[rgb] = random(100, 256);
+    }
+    // Second color (0 - 256)
+    else {
+      colors[rgb] = random(0, 256);
+    }
+  }
 
-    // Change color/direction if fading is done
-    if(is_shelf_fading(s) == false) {
+  // Random duration
+  int shelf_duration = random(1000, 2000);
 
-      // Fade down
-      if (direction[s] == 1) {
-        fade_shelf(s, 0, 0, 0, duration[s]);
-        direction[s] = -1;
-      }
+  // Fade up, then straight back down
+  fade_shelf(s, colors[0], colors[1], colors[2], shelf_duration);
+  queue_shelf(s, 0, 0, 0, shelf_duration);
 
-      // Fade up
-      else {
-        if (s == 1) {
-          Serial.print("Change color ");
-          Serial.println(s);
-        }
-
-        // Generate random pwm on two colors
-        byte colors[3] = {0,0,0};
-        for(byte i = 0; i < 2; i++) {
-          byte rgb = random(0, 3);
-
-          // First color (100 - 256)
-          if (i == 0) {
-            colors[rgb] = random(100, 256);
-          }
-          // Second color (0 - 256)
-          else {
-            colors[rgb] = random(0, 256);
-          }
-        }
-
-        // Random duration
-        int shelf_duration = random(1000, 2000);
-
-        // Start fade
-        fade_shelf(s, colors[0], colors[1], colors[2], shelf_duration);
-        duration[s] = shelf_duration;
-        direction[s] = 1;
-
-
-        Serial.print("Fade up shelf ");
-        Serial.println(s);
-
-        Serial.print(colors[0]);
-        Serial.print(", ");
-        Serial.print(colors[1]);
-        Serial.print(", ");
-        Serial.print(colors[2]);
-        Serial.print(" -> ");
-        Serial.println(duration[s]);
-      }
+  LOG_DEBUG("Fade up shelf %u: %u, %u, %u -> %d", s, colors[0], colors[1], colors[2], shelf_duration);
+}
+void Program1::run() {
+
+  // Give each shelf a new color when it's done fading (nothing to do in between)
+  if (!shelves.finished()) {
+    return;
+  }
+  for (byte s = 0; s < SHELVES; s++) {
+    if (is_shelf_finished(s)) {
+      start_shelf(s);
     }
   }
 }
@@ -442,22 +566,43 @@ void Program1::run() {
  Use the remote Up/Down arrows to make the transition faster or slower.
  -------------------------
 */
-Program2::Program2() {
-  *colors = (0,0,0);
-  speed = 3000;
-  index = 0;
+// Green, blue, red, over and over. Each fade is written to take TEMPO_NORMAL,
+// so played at a tempo of speed, each one takes speed milliseconds.
+const Keyframe program2_show[] PROGMEM = {
+  KEY_LOOP(0),
+    KEY(ALL_SHELVES, 0, 255, 0, TEMPO_NORMAL, EASE_LINEAR | EASE_HUE),
+    KEY(ALL_SHELVES, 0, 0, 255, TEMPO_NORMAL, EASE_LINEAR | EASE_HUE),
+    KEY(ALL_SHELVES, 255, 0, 0, TEMPO_NORMAL, EASE_LINEAR | EASE_HUE),
+  KEY_REPEAT()
+};
+
+void Program2::enter() {
+  speed = settings.program2_speed;
+  sequencer.play(program2_show, speed);
+}
+
+void Program2::exit() {
+  sequencer.stop();
+}
+
+// Keep the speed for next time
+void Program2::save_speed() {
+  settings.program2_speed = speed;
+  save_settings();
 }
 
 // The main part of the program, run once each loop() cycle
 void Program2::run() {
 
   // Adjust speed
-  if (ir_value == IR_DOWN) {
+  if (ir_value == IR_DOWN && speed < 30000) {
     speed += 100;
     change_speed(100);
+    sequencer.set_tempo(speed);
+    sequencer.shift(100);
 
-    Serial.print("Slow down: ");
-    Serial.println(speed);
+    LOG_INFO("Slow down: %d", speed);
+    save_speed();
   }
   else if (ir_value == IR_UP) {
     speed -= 100;
@@ -467,28 +612,11 @@ void Program2::run() {
       speed  = 500;
     }
     change_speed(-100);
+    sequencer.set_tempo(speed);
+    sequencer.shift(-100);
 
-    Serial.print("Speed up: ");
-    Serial.println(speed);
-  }
-
-  // Move to the next color if fading on all shelves is done
-  if (!is_fading) {
-    colors[index] = 0;            // current color fades to 0
-    index = wrap(++index, 0, 2);  // Increment index and wrap to 0, if greater than 2
-    colors[index] = 255;          // next color fades to 255
-
-    Serial.print("Move to the next color");
-    Serial.println(index);
-
-    Serial.print(colors[0]);
-    Serial.print(", ");
-    Serial.print(colors[1]);
-    Serial.print(", ");
-    Serial.println(colors[2]);
-
-    // Fade to the next color
-    fade_all(colors[0], colors[1], colors[2], speed);
+    LOG_INFO("Speed up: %d", speed);
+    save_speed();
   }
 }
 
@@ -502,50 +630,75 @@ void Program2::run() {
  Select:     Clears the colors.
  -------------------------
 */
-Program3::Program3() {
+void Program3::enter() {
   inc = 20;
   color_select = 0;
-  *colors = (0,0,0);
+  colors[0] = 0;
+  colors[1] = 0;
+  colors[2] = 0;
   last_ir = 0;
+  phase = IDLE;
 
   // Load previously used colors from EEPROM: select, r, g, b
-  byte select = EEPROM.read(0);
-  if (select <= 2) {
-    colors[0] = constrain(EEPROM.read(1), 0, 255);
-    colors[1] = constrain(EEPROM.read(2), 0, 255);
-    colors[2] = constrain(EEPROM.read(3), 0, 255);
-
-    // Fade to the color
-    fade_all(colors[0], colors[1], colors[2], 500);
-    delay(500);
+  // (boards that saved them before the slot ring have them at 0 - 3)
+  SavedColors saved;
+  if (!color_store.load(saved)) {
+    saved.select = EEPROM.read(0);
+    saved.colors[0] = EEPROM.read(1);
+    saved.colors[1] = EEPROM.read(2);
+    saved.colors[2] = EEPROM.read(3);
+  }
+  if (saved.select <= 2) {
+    colors[0] = saved.colors[0];
+    colors[1] = saved.colors[1];
+    colors[2] = saved.colors[2];
+
+    // Fade to the color, and blink once it's there (see run())
+    fade_all(colors[0], colors[1], colors[2], RESTORE_TIME);
+    phase = RESTORING;
+    phase_end = millis() + RESTORE_TIME;
   }
   else {
     off();
+    blink();
   }
-
-  blink();
 }
 
 // Blink the color that is selected
+// run() fades back to the colors once BLINK_TIME is up
 void Program3::blink(){
   int blink_colors[3] = {0,0,0};
   blink_colors[color_select] = 150;
 
   set_all(blink_colors[0], blink_colors[1], blink_colors[2]);
-  delay(400);
-  fade_all(colors[0], colors[1], colors[2], 500);
+  phase = BLINKING;
+  phase_end = millis() + BLINK_TIME;
 }
 
-// Save the current values to the EEPROM
+// Save the current values to the EEPROM (once they stop changing)
 void Program3::save(){
-  EEPROM.write(0, color_select);
-  EEPROM.write(1, colors[0]);
-  EEPROM.write(2, colors[1]);
-  EEPROM.write(3, colors[2]);
+  SavedColors saved;
+  saved.select = color_select;
+  saved.colors[0] = colors[0];
+  saved.colors[1] = colors[1];
+  saved.colors[2] = colors[2];
+  color_store.save(saved);
 }
 
 // The main part of the program, run once each loop() cycle
 void Program3::run() {
+
+  // Move on when the restore fade or the blink is over
+  if (phase != IDLE && (long)(millis() - phase_end) >= 0) {
+    if (phase == RESTORING) {
+      blink();
+    }
+    else {
+      phase = IDLE;
+      fade_all(colors[0], colors[1], colors[2], 500);
+    }
+  }
+
   if (ir_value) {
 
     int color = colors[color_select];
@@ -561,15 +714,13 @@ void Program3::run() {
     // Increase selected color
     case IR_UP:
       color += inc;
-      Serial.print("Increase color ");
-      Serial.println(color_select);
+      LOG_DEBUG("Increase color %u", color_select);
     break;
 
     // Decrease selected color
     case IR_DOWN:
       color -= inc;
-      Serial.print("Decrease color ");
-      Serial.println(color_select);
+      LOG_DEBUG("Decrease color %u", color_select);
     break;
 
     // Move to the next color
@@ -578,8 +729,7 @@ void Program3::run() {
       color_select = wrap(color_select, 0, 2);
       color = colors[color_select];
 
-      Serial.print("Move color to");
-      Serial.println(color_select);
+      LOG_DEBUG("Move color to %u", color_select);
 
       blink();
     break;
@@ -590,26 +740,66 @@ void Program3::run() {
       color_select = wrap(color_select, 0, 2);
       color = colors[color_select];
 
-      Serial.print("Move color to");
-      Serial.println(color_select);
+      LOG_DEBUG("Move color to %u", color_select);
 
       blink();
     break;
     }
     ir_value = 0;
 
-    // Set colors
+    // Set colors (a blink fades to them when it's done)
     color = constrain(color, 0, 255);
     colors[color_select] = color;
-    fade_all(colors[0], colors[1], colors[2], 100);
+    if (phase != BLINKING) {
+      fade_all(colors[0], colors[1], colors[2], 100);
+    }
 
-    Serial.print(colors[0]);
-    Serial.print(", ");
-    Serial.print(colors[1]);
-    Serial.print(", ");
-    Serial.println(colors[2]);
+    LOG_INFO("Color: %u, %u, %u", colors[0], colors[1], colors[2]);
 
     // Save values to EEPROM
     save();
   }
 }
+
+/*
+ -------------------------
+ Program 4
+ Show the frames streamed from a PC on the USB serial port
+ -------------------------
+*/
+static_assert(STREAM_VALUES == SHELVES * RGB, "a streamed frame has a value for each shelf LED");
+
+void Program4::enter() {
+  shelves.stop_all();
+  frame_stream.reset();
+  LOG_INFO("Streaming");
+}
+
+void Program4::exit() {
+  LOG_INFO("Stream: %lu frames, %lu bad, %lu dropped, %lu late", frame_stream.get_frames(),
+      frame_stream.get_bad(), frame_stream.get_dropped(), frame_stream.get_late());
+}
+
+// The main part of the program, run once each loop() cycle
+void Program4::run() {
+  bool ready = frame_stream.poll();
+
+  // Back to the program that was running before
+  if (frame_stream.stopped()) {
+    start_program(settings.program);
+    return;
+  }
+  if (!ready) {
+    return;
+  }
+
+  // Fades toward each frame, retargeted by the next one, keep the motion smooth between frames
+  const StreamFrame &frame = frame_stream.take(millis());
+  for (byte shelf = 0; shelf < SHELVES; shelf++) {
+    if (frame.fade) {
+      shelves.retarget_group(shelf, &frame.values[shelf * RGB], frame.fade);
+    } else {
+      shelves.set_group(shelf, &frame.values[shelf * RGB]);
+    }
+  }
+}
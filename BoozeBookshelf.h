@@ -10,6 +10,17 @@
 #include "Arduino.h"
 #include "EEPROM.h"
 #include "LEDFader.h"
+#include "FaderBank.h"
+#include "Log.h"
+#include "Profile.h"
+#include "Trace.h"
+#include "MaxSonar.h"
+#include "FrameStream.h"
+#include "DistanceFilter.h"
+#include "EEPROMStore.h"
+#include "Settings.h"
+#include "Console.h"
+#include "Sequencer.h"
 
 /*
  =================
@@ -22,13 +33,60 @@
 #define RGB 3     // Number of LED colors per shelf (R, G, B)
 
 // Proximity sensor range distance values in millimeters
+// (CLOSE_RANGE, MED_RANGE, OUT_OF_RANGE_DELAY and RANGE_HYSTERESIS are the defaults for the settings, see Settings.h)
 #define CLOSE_RANGE 850
 #define MED_RANGE 1000
 #define OUT_OF_RANGE_DELAY 500 // Number of seconds to wait before fading out when a person goes out of range
-
-// Time it takes to fade the LEDs on/off when someone approaches the bookshelf (in milliseconds)
+#define SONAR_TIMEOUT 1000 // Readings older than this (in milliseconds) are ignored
+#define MIN_RANGE 30 // Readings at or below this are too close for the sensor and are ignored
+
+// Sonar filtering: the median of this many readings, averaged with 1 / 2^DISTANCE_SMOOTHING of each new one
+#define DISTANCE_MEDIAN 5
+#define DISTANCE_SMOOTHING 2
+
+// Once in range, how much further (in millimeters) than MED_RANGE a person has to go to be out of range
+#define RANGE_HYSTERESIS 50
+
+// Gamma of the brightness curve for each LED color, in hundredths (220 = 2.2), when built
+// with SHELF_GAMMA=1. The R, G and B strips don't have the same perceptual response, so each
+// gets its own. The shelves are linear by default: every program's levels were picked for a
+// linear curve, and with these gammas Program0's medium range (30) comes out at about 2/255.
+#ifndef SHELF_GAMMA
+#define SHELF_GAMMA 0
+#endif
+#define GAMMA_RED 200
+#define GAMMA_GREEN 240
+#define GAMMA_BLUE 220
+
+// Fades waiting in each shelf LED's queue: a fade through hues (see set_fade_mode()) takes up to 4
+#define SHELF_QUEUE 4
+
+// How fade_shelf(), queue_shelf() and fade_all() get to a color:
+// straight across RGB, or round the color wheel keeping brightness and saturation
+#define FADE_RGB 0
+#define FADE_HUE 1
+
+// Time it takes to fade the LEDs on/off when someone approaches the bookshelf (in milliseconds, default setting)
 #define FADE_SPEED 2000
 
+// How long program 2 takes for each color change (in milliseconds, default setting)
+#define PROGRAM2_SPEED 3000
+
+// In follow mode (Select on the remote, in program 0), the time it takes the LEDs to
+// catch up with a new distance (in milliseconds)
+#define FOLLOW_TIME 400
+
+// Program 3 keeps its colors in a ring of EEPROM slots (see EEPROMStore.h), and saves
+// them once they've been left alone for COLORS_SAVE_DELAY milliseconds
+#define COLORS_EEPROM_ADDRESS 16
+#define COLORS_EEPROM_SLOTS 16
+#define COLORS_SAVE_DELAY 3000
+
+// The settings block (see Settings.h) goes in its own ring of slots
+#define SETTINGS_EEPROM_ADDRESS 256
+#define SETTINGS_EEPROM_SLOTS 4
+#define SETTINGS_SAVE_DELAY 2000
+
 // IR Codes received via Serial from the Arduino mini
 #define IR_POWER 'P'
 #define IR_A 'A'
@@ -40,6 +98,51 @@
 #define IR_RIGHT 'r'
 #define IR_SELECT 's'
 
+// The stream program (frames from a PC on the USB serial port) has no button on the remote,
+// it's started with the console's "stream" command
+#define PROGRAM_STREAM 4
+
+/*
+ =================
+ Program state
+ =================
+ */
+
+// Brightness curves for the shelves, built at compile time (straight through unless SHELF_GAMMA)
+#if SHELF_GAMMA
+typedef RGBCurve<GammaCurve<GAMMA_RED>, GammaCurve<GAMMA_GREEN>, GammaCurve<GAMMA_BLUE> > ShelfCurve;
+#else
+typedef UniformCurve<LinearCurve> ShelfCurve;
+#endif
+
+// All the shelf LEDs, faded together as SHELVES groups of RGB channels, at 12 bits on the
+// pins on 16-bit timers
+extern FaderBank<SHELVES, RGB, ShelfCurve, SHELF_QUEUE, TimerOutput> shelves;
+
+// Proximity sensor on Serial2
+extern MaxSonar sonar;
+
+// Frames streamed to the stream program on the USB serial port
+extern FrameStream frame_stream;
+
+// Filters the sonar readings for get_distance()
+extern DistanceFilter distance_filter;
+
+// Plays keyframe shows (see Sequencer.h) on the shelves
+extern Sequencer sequencer;
+
+// What program 3 saves in the EEPROM
+struct SavedColors {
+  byte select;      // The color selected (0 - 2: R,G,B)
+  byte colors[RGB]; // The value of each color
+};
+
+// Program 3's saved colors
+extern EEPROMStore<SavedColors> color_store;
+
+// The number of the program running
+extern byte current_program_num;
+
 /*
  =================
  Program Functions
@@ -62,6 +165,17 @@ void setup();
  */
 byte run_program();
 
+/**
+ * Leave the current program and start another one by its number
+ * (the one started at power up is the last one started, other than PROGRAM_STREAM)
+ */
+void start_program(byte num);
+
+/**
+ * Put changed settings into effect
+ */
+void apply_settings();
+
 /**
  * Utility function, like 'constrain', but when val is larger than max, it becomes min
  * and when it is less than min, it becomes max
@@ -69,8 +183,8 @@ byte run_program();
 int wrap(int val, int min, int max);
 
 /**
- * Get the distance, in mm, from the MaxSonar sensor
- * (code adapted from http://forum.arduino.cc/index.php?topic=130842.0)
+ * Get the distance, in mm, from the MaxSonar sensor.
+ * Reads every frame that has arrived on Serial2 and returns the filtered distance.
  */
 int get_distance();
 
@@ -94,11 +208,23 @@ void set_shelf(byte shelf, byte r, byte g, byte b);
  */
 void set_all(byte r, byte g, byte b);
 
+/**
+ * Fade shelves through RGB (FADE_RGB) or hues (FADE_HUE) from now on.
+ * Every program starts out with FADE_RGB.
+ */
+void set_fade_mode(byte mode);
+
 /**
  * Fade a shelf to an RGB color
  */
 void fade_shelf(byte shelf, byte r, byte g, byte b, int duration);
 
+/**
+ * Fade a shelf to an RGB color after the fades already started or queued on it
+ * Returns FALSE if its queue is full
+ */
+bool queue_shelf(byte shelf, byte r, byte g, byte b, int duration);
+
 /**
  * Fade all shelves to white, at an intensity between 0 - 255
  */
@@ -120,6 +246,11 @@ void change_speed(int by);
  */
 bool is_shelf_fading(byte shelf);
 
+/**
+ * Returns true if the shelf's fades finished in this loop()
+ */
+bool is_shelf_finished(byte shelf);
+
 /*
  =================
  Program Classes
@@ -132,30 +263,50 @@ bool is_shelf_fading(byte shelf);
  */
 class Program {
   public:
+    /**
+     * Called when the program is selected (programs are never created or destroyed,
+     * so this is where a program resets its state)
+     */
+    virtual void enter();
+
     /**
      * Called once for each loop() cycle, while the program is selected
      */
-    virtual void run();
+    virtual void run() = 0;
+
+    /**
+     * Called when another program is about to be selected
+     */
+    virtual void exit();
 };
 
 /*
  * Program 0
  * The default program that fades the LEDs Up when someone walks up to the bookshelf and
  * fades them down when the person walks away.
+ *
+ * Select:     Switches between the close/medium ranges and following the distance smoothly.
  */
 class Program0 : public Program {
 
-  // If the person is in close range. (LEDs at 100%) See CLOSE_RANGE constant.
+  // Brightness follows the distance along follow_curve, instead of the range steps
+  // (kept when the program is restarted)
+  bool follow;
+
+  // If the person is in close range. (LEDs at 100%) See settings.close_range.
   bool range_close;
 
-  // If the person is at medium range. (LEDS at 50%) See MED_RANGE constant.
+  // If the person is at medium range. (LEDS at 50%) See settings.med_range.
   bool range_medium;
 
-  // When to dim the LEDs when a person goes out of range. time() + OUT_OF_RANGE_DELAY
+  // When to dim the LEDs when a person goes out of range. time() + settings.out_of_range_delay
   unsigned long out_range_timer;
 
+  // Brightness for a distance along follow_curve
+  static byte follow_brightness(int distance);
+
   public:
-    Program0();
+    void enter();
     void run();
 };
 
@@ -164,14 +315,11 @@ class Program0 : public Program {
  * Fade a random color up/down on each shelf independant of all other shelves
  */
 class Program1 : public Program {
-  // The fade direction for each shelf (1 = up, -1 = down)
-  int direction[SHELVES];
-
-  // The duration for each shelf fade
-  int duration[SHELVES];
+  // Fade a shelf up to a random color and back down
+  void start_shelf(byte shelf);
 
   public:
-    Program1();
+    void enter();
     void run();
 };
 
@@ -182,18 +330,15 @@ class Program1 : public Program {
  */
 class Program2 : public Program{
 
-  // The value of each RGB color
-  int colors[RGB];
-
-  // The current color index being increased (R=0, G=1, B=2)
-  int index;
-
   // The duration of the transition from one color to another
   int speed;
 
+  void save_speed();
+
   public:
-    Program2();
+    void enter();
     void run();
+    void exit();
 };
 
 /**
@@ -207,6 +352,10 @@ class Program2 : public Program{
 class Program3 : public Program{
 private:
 
+  // How long the restored colors fade in, and how long the selected color flashes (milliseconds)
+  static const unsigned int RESTORE_TIME = 500;
+  static const unsigned int BLINK_TIME = 400;
+
   // The color we're currently modifying (0 - 2: R,G,B)
   byte color_select;
 
@@ -219,13 +368,38 @@ private:
   // The last IR value received
   char last_ir;
 
+  // What the LEDs are busy with, instead of blocking loop() with delay()
+  enum Phase {
+    IDLE,       // Showing the mixed color
+    RESTORING,  // Fading in the colors loaded from EEPROM, then blink
+    BLINKING    // Flashing the selected color, then fade back to the mix
+  };
+  Phase phase;
+
+  // When the current phase is over
+  unsigned long phase_end;
+
   void blink();
   void save();
 public:
-  Program3();
+  void enter();
   void run();
 };
 
+/**
+ * Program 4
+ * Show the frames a PC streams on the USB serial port (see FrameStream.h), for a dance party.
+ * The console's "stream" command starts it. While it runs, the port takes frames instead of
+ * console commands, until a stop frame comes in (back to the program before) or a program
+ * button on the remote is pressed.
+ */
+class Program4 : public Program {
+  public:
+    void enter();
+    void run();
+    void exit();
+};
+
 
 //Do not add code below this line
 #endif /* BoozeBookshelf_H_ */
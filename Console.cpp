@@ -0,0 +1,187 @@
+/*
+ * Console.cpp
+ *
+ * Serial command console for the settings. See Console.h
+ */
+
+#include <stdlib.h>
+#include "BoozeBookshelf.h"
+#include "Console.h"
+
+// The commands built in, for the help line
+#if PROFILE
+#define PROFILE_HELP ", profile [reset]"
+#else
+#define PROFILE_HELP ""
+#endif
+#if TRACE
+#define TRACE_HELP ", trace [clear]"
+#else
+#define TRACE_HELP ""
+#endif
+
+Console::Console(Stream &stream) : in(stream) {
+  length = 0;
+  too_long = false;
+  listing = -1;
+#if PROFILE
+  reporting = -1;
+#endif
+#if TRACE
+  dumping = -1;
+#endif
+}
+
+void Console::poll() {
+
+  // Carry on listing, a line at a time while the log has room for it
+  if (listing >= 0 && logger.pending() < LOG_BUFFER_SIZE / 2) {
+    show(listing++);
+    if (listing >= setting_count()) {
+      listing = -1;
+    }
+  }
+
+#if PROFILE
+  // The profile report's lines are long, so each one waits for the log to be empty
+  if (reporting >= 0 && !logger.pending()) {
+    profiler.report(reporting++);
+    if (reporting >= profiler.report_lines()) {
+      reporting = -1;
+      profiler.hold(false);
+    }
+  }
+#endif
+
+#if TRACE
+  // So are the trace's
+  if (dumping >= 0 && !logger.pending()) {
+    if (!tracer.report(dumping++)) {
+      dumping = -1;
+      tracer.hold(false);
+    }
+  }
+#endif
+
+  while (in.available() > 0) {
+    char c = in.read();
+
+    if (c == '\r' || c == '\n') {
+      if (too_long) {
+        logger.printf(F("Line too long"));
+      }
+      else if (length) {
+        line[length] = 0;
+        length = 0;
+        run();
+
+        // One command a loop: the next bytes may not be meant for the console (see "stream")
+        return;
+      }
+      length = 0;
+      too_long = false;
+    }
+    else if (length < CONSOLE_LINE_SIZE - 1) {
+      line[length++] = c;
+    }
+    else {
+      too_long = true;
+    }
+  }
+}
+
+void Console::show(uint8_t index) {
+  logger.printf(F("%S %u"), setting_name(index), get_setting(index));
+}
+
+void Console::run() {
+
+  // Split the line into the command and up to two arguments
+  char *args[3] = { 0, 0, 0 };
+  uint8_t count = 0;
+  for (char *p = line; *p && count < 3;) {
+    while (*p == ' ') *p++ = 0;
+    if (!*p) break;
+    args[count++] = p;
+    while (*p && *p != ' ') p++;
+  }
+  if (!count) {
+    return;
+  }
+
+  // get [NAME]
+  if (!strcmp_P(args[0], PSTR("get"))) {
+    if (count == 1) {
+      listing = 0;
+      return;
+    }
+    int index = find_setting(args[1]);
+    if (index < 0) {
+      logger.printf(F("No setting %s"), args[1]);
+      return;
+    }
+    show(index);
+  }
+
+  // set NAME VALUE
+  else if (!strcmp_P(args[0], PSTR("set")) && count == 3) {
+    int index = find_setting(args[1]);
+    if (index < 0) {
+      logger.printf(F("No setting %s"), args[1]);
+      return;
+    }
+    char *end;
+    long value = strtol(args[2], &end, 10);
+    if (*end || !set_setting(index, value)) {
+      logger.printf(F("Bad value for %s: %s"), args[1], args[2]);
+      return;
+    }
+    apply_settings();
+    save_settings();
+    show(index);
+  }
+
+  // defaults
+  else if (!strcmp_P(args[0], PSTR("defaults"))) {
+    reset_settings();
+    apply_settings();
+    save_settings();
+    logger.printf(F("Defaults"));
+  }
+
+  // stream
+  else if (!strcmp_P(args[0], PSTR("stream"))) {
+    start_program(PROGRAM_STREAM);
+  }
+
+#if PROFILE
+  // profile [reset]
+  else if (!strcmp_P(args[0], PSTR("profile"))) {
+    if (count == 2 && !strcmp_P(args[1], PSTR("reset"))) {
+      profiler.reset();
+      logger.printf(F("Profile reset"));
+      return;
+    }
+    reporting = 0;
+    profiler.hold(true);
+  }
+#endif
+
+#if TRACE
+  // trace [clear]
+  else if (!strcmp_P(args[0], PSTR("trace"))) {
+    if (count == 2 && !strcmp_P(args[1], PSTR("clear"))) {
+      tracer.clear();
+      dumping = -1;
+      logger.printf(F("Trace cleared"));
+      return;
+    }
+    dumping = 0;
+    tracer.hold(true);
+  }
+#endif
+
+  else {
+    logger.printf(F("Commands: get [NAME], set NAME VALUE, defaults, stream" PROFILE_HELP TRACE_HELP));
+  }
+}
@@ -0,0 +1,61 @@
+/*
+ * Console.h
+ *
+ * A line based command console on the USB serial port, for changing the
+ * settings (see Settings.h) without a reflash:
+ *
+ *   get              List every setting
+ *   get NAME         Show one setting
+ *   set NAME VALUE   Change a setting (it's saved to the EEPROM a moment later)
+ *   defaults         Go back to the default settings
+ *   stream           Take frames from a PC on this port instead (see FrameStream.h)
+ *   profile          Print where loop()'s time goes (built with PROFILE, see Profile.h)
+ *   profile reset    Start counting again
+ *   trace            Print the IR and sonar input recorded (built with TRACE, see Trace.h)
+ *   trace clear      Start recording again
+ *
+ * poll() only collects the bytes that have arrived, so loop() pays nothing
+ * until a whole line is in, and runs at most one command a call. Replies go
+ * through the logger, a line per call while listing, so they never block
+ * either.
+ */
+
+#ifndef Console_H_
+#define Console_H_
+
+#include "Arduino.h"
+
+// Longest command line
+#define CONSOLE_LINE_SIZE 40
+
+class Console {
+  Stream &in;
+
+  char line[CONSOLE_LINE_SIZE];
+  uint8_t length;
+  bool too_long;
+
+  // The next setting to list for "get", or -1 when not listing
+  int listing;
+
+#if PROFILE
+  // The next line of the profile report, or -1 when not reporting
+  int reporting;
+#endif
+
+#if TRACE
+  // The next line of the trace being printed, or -1 when not printing it
+  int dumping;
+#endif
+
+  void run();
+  void show(uint8_t index);
+
+public:
+  Console(Stream &stream);
+
+  // Read what has arrived, and run the command once a line is complete
+  void poll();
+};
+
+#endif /* Console_H_ */
@@ -0,0 +1,63 @@
+/*
+ * DistanceFilter.cpp
+ *
+ * Median and moving average filter for the sonar readings. See DistanceFilter.h
+ */
+
+#include "DistanceFilter.h"
+
+DistanceFilter::DistanceFilter(uint8_t median_window, uint8_t ema_shift) {
+  configure(median_window, ema_shift);
+}
+
+void DistanceFilter::configure(uint8_t median_window, uint8_t ema_shift) {
+  window = constrain(median_window, 1, DISTANCE_MEDIAN_MAX);
+  shift = constrain(ema_shift, 0, 8);
+  reset();
+}
+
+void DistanceFilter::reset() {
+  count = 0;
+  next = 0;
+  average = -1;
+}
+
+// The median of the readings held (insertion sort of a copy, it's only a few values)
+unsigned int DistanceFilter::median() {
+  unsigned int sorted[DISTANCE_MEDIAN_MAX];
+
+  for (uint8_t i = 0; i < count; i++) {
+    unsigned int v = samples[i];
+    uint8_t j = i;
+    while (j > 0 && sorted[j - 1] > v) {
+      sorted[j] = sorted[j - 1];
+      j--;
+    }
+    sorted[j] = v;
+  }
+  return sorted[count / 2];
+}
+
+unsigned int DistanceFilter::add(unsigned int distance) {
+  samples[next] = distance;
+  next = (next + 1) % window;
+  if (count < window) {
+    count++;
+  }
+
+  long m = (long)median() << 4;
+  if (average < 0) {
+    average = m;
+  }
+  else {
+    average += (m - average) >> shift;
+  }
+  return get();
+}
+
+unsigned int DistanceFilter::get() {
+  if (average < 0) {
+    return 0;
+  }
+  return (average + 8) >> 4;
+}
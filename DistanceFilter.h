@@ -0,0 +1,48 @@
+/*
+ * DistanceFilter.h
+ *
+ * Smooths the sonar readings before Program0 compares them to its ranges.
+ *
+ * Each reading goes through a running median of the last few readings,
+ * which throws out single-sample spikes and dropouts, and then through an
+ * exponential moving average, which evens out the jitter that's left.
+ * It's all integer math: the average is kept in 1/16 mm.
+ */
+
+#ifndef DistanceFilter_H_
+#define DistanceFilter_H_
+
+#include "Arduino.h"
+
+// The most readings the median can look at
+#define DISTANCE_MEDIAN_MAX 7
+
+class DistanceFilter {
+  unsigned int samples[DISTANCE_MEDIAN_MAX];
+  uint8_t window;   // Readings the median looks at
+  uint8_t count;    // Readings held, up to window
+  uint8_t next;     // Where the next reading goes
+
+  uint8_t shift;    // The average moves 1 / 2^shift of the way to each median
+  long average;     // In 1/16 mm, or -1 before the first reading
+
+  unsigned int median();
+
+public:
+  DistanceFilter(uint8_t median_window, uint8_t ema_shift);
+
+  // Change the filter settings (clears the readings)
+  // A window of 1 and a shift of 0 passes readings straight through.
+  void configure(uint8_t median_window, uint8_t ema_shift);
+
+  // Forget all readings
+  void reset();
+
+  // Add a reading, in mm, and return the new filtered distance
+  unsigned int add(unsigned int distance);
+
+  // The filtered distance, in mm (0 before the first reading)
+  unsigned int get();
+};
+
+#endif /* DistanceFilter_H_ */
@@ -0,0 +1,220 @@
+/*
+ * EEPROMStore.h
+ *
+ * Keeps a small record in EEPROM without stalling loop() or wearing out
+ * the same few cells.
+ *
+ *  - save() only copies the record to RAM. It's written once it has stayed
+ *    the same for commit_delay milliseconds, so holding a button down ends
+ *    up as one write instead of one per press.
+ *  - poll() writes the record a byte at a time, and only when the EEPROM
+ *    isn't busy with the last byte, so it never waits the ~3.3 ms a byte
+ *    write takes. Bytes that already hold the right value aren't written.
+ *  - Each write goes to the next of a ring of slots, which spreads the wear
+ *    across all of them. A slot holds a sequence number, the record and a
+ *    CRC (written last), so load() can pick the newest complete slot, even
+ *    if the power went out in the middle of a write.
+ *
+ * Slot layout: sequence (2 bytes), RECORD, CRC-CCITT of the two (2 bytes)
+ */
+
+#ifndef EEPROMStore_H_
+#define EEPROMStore_H_
+
+#include <util/crc16.h>
+#include "Arduino.h"
+#include "EEPROM.h"
+
+template <class RECORD>
+class EEPROMStore {
+public:
+  enum { SLOT_SIZE = 2 + sizeof(RECORD) + 2 };
+
+private:
+  int base;
+  uint8_t slots;
+  unsigned int commit_delay;
+
+  // The newest slot in EEPROM and its sequence number, once scan() has looked
+  uint8_t newest;
+  uint16_t sequence;
+  bool scanned;
+
+  // The last record saved, and when, while it's waiting to be written
+  RECORD pending;
+  bool changed;
+  unsigned long changed_at;
+
+  // The slot being written, a byte at a time
+  uint8_t staged[SLOT_SIZE];
+  int staged_address;
+  uint8_t staged_pos;
+
+  unsigned long commits;
+
+  static uint16_t crc(const uint8_t *data, uint8_t size) {
+    uint16_t c = 0xFFFF;
+    for (uint8_t i = 0; i < size; i++) {
+      c = _crc_ccitt_update(c, data[i]);
+    }
+    return c;
+  }
+
+  int slot_address(uint8_t slot) { return base + (int)slot * SLOT_SIZE; }
+
+  bool writing() { return staged_pos < SLOT_SIZE; }
+
+  // Read a slot. Returns true, with the sequence number, if its CRC checks out.
+  bool read_slot(uint8_t slot, uint8_t *buffer, uint16_t &seq);
+
+  // Find the newest slot, and copy its record if there is one. Returns FALSE if there isn't.
+  bool scan(RECORD *record);
+
+  // Lay out the pending record in the next slot, for poll() to write
+  void stage();
+
+public:
+
+  // Keep records in slots slots starting at base_address (slots * SLOT_SIZE bytes),
+  // and write them once they've been left alone for commit_delay milliseconds
+  EEPROMStore(int base_address, uint8_t slots, unsigned int commit_delay);
+
+  // Get the newest record (including one that's saved but not written yet)
+  // Returns FALSE if there is none.
+  bool load(RECORD &record);
+
+  // Save a record. It's written by poll() once it has stopped changing.
+  void save(const RECORD &record);
+
+  // Write what's due, without waiting on the EEPROM. Call it every loop().
+  void poll(unsigned long now);
+
+  // Returns TRUE while there is a saved record that isn't in the EEPROM yet
+  bool busy() { return changed || writing(); }
+
+  // Number of records written to the EEPROM
+  unsigned long get_commits() { return commits; }
+
+  // Number of bytes the store takes
+  int size() { return (int)slots * SLOT_SIZE; }
+};
+
+template <class RECORD>
+EEPROMStore<RECORD>::EEPROMStore(int base_address, uint8_t slot_count, unsigned int delay_ms) {
+  base = base_address;
+  slots = slot_count;
+  commit_delay = delay_ms;
+  newest = slot_count - 1;
+  sequence = 0;
+  scanned = false;
+  changed = false;
+  changed_at = 0;
+  staged_address = base_address;
+  staged_pos = SLOT_SIZE;
+  commits = 0;
+}
+
+template <class RECORD>
+bool EEPROMStore<RECORD>::read_slot(uint8_t slot, uint8_t *buffer, uint16_t &seq) {
+  int address = slot_address(slot);
+  for (uint8_t i = 0; i < SLOT_SIZE; i++) {
+    buffer[i] = EEPROM.read(address + i);
+  }
+
+  uint16_t stored = buffer[SLOT_SIZE - 2] | (buffer[SLOT_SIZE - 1] << 8);
+  if (crc(buffer, SLOT_SIZE - 2) != stored) {
+    return false;
+  }
+  seq = buffer[0] | (buffer[1] << 8);
+  return true;
+}
+
+template <class RECORD>
+bool EEPROMStore<RECORD>::load(RECORD &record) {
+
+  // Newer than anything in the EEPROM
+  if (busy()) {
+    record = pending;
+    return true;
+  }
+  return scan(&record);
+}
+
+template <class RECORD>
+bool EEPROMStore<RECORD>::scan(RECORD *record) {
+  uint8_t buffer[SLOT_SIZE];
+  bool found = false;
+
+  for (uint8_t slot = 0; slot < slots; slot++) {
+    uint16_t seq;
+    if (!read_slot(slot, buffer, seq)) {
+      continue;
+    }
+
+    // Newer, allowing for the sequence number wrapping around
+    if (!found || (int16_t)(seq - sequence) > 0) {
+      found = true;
+      newest = slot;
+      sequence = seq;
+      if (record) {
+        memcpy(record, buffer + 2, sizeof(RECORD));
+      }
+    }
+  }
+  if (!found) {
+    newest = slots - 1;
+    sequence = 0;
+  }
+  scanned = true;
+  return found;
+}
+
+template <class RECORD>
+void EEPROMStore<RECORD>::save(const RECORD &record) {
+  pending = record;
+  changed = true;
+  changed_at = millis();
+}
+
+template <class RECORD>
+void EEPROMStore<RECORD>::stage() {
+
+  // Carry on from the newest slot, not over it
+  if (!scanned) {
+    scan(0);
+  }
+  newest = (newest + 1) % slots;
+  sequence++;
+
+  staged[0] = sequence & 0xFF;
+  staged[1] = sequence >> 8;
+  memcpy(staged + 2, &pending, sizeof(RECORD));
+  uint16_t c = crc(staged, SLOT_SIZE - 2);
+  staged[SLOT_SIZE - 2] = c & 0xFF;
+  staged[SLOT_SIZE - 1] = c >> 8;
+
+  staged_address = slot_address(newest);
+  staged_pos = 0;
+  changed = false;
+}
+
+template <class RECORD>
+void EEPROMStore<RECORD>::poll(unsigned long now) {
+  if (!writing()) {
+    if (!changed || now - changed_at < commit_delay) {
+      return;
+    }
+    stage();
+  }
+
+  // Bytes that are already right go by for free; stop at the first real write
+  while (writing() && EEPROM.ready()) {
+    EEPROM.update(staged_address + staged_pos, staged[staged_pos]);
+    staged_pos++;
+  }
+  if (!writing()) {
+    commits++;
+  }
+}
+
+#endif /* EEPROMStore_H_ */
@@ -0,0 +1,134 @@
+/*
+ * FrameStream.cpp
+ *
+ * Reads shelf frames streamed on the USB serial port. See FrameStream.h
+ */
+
+#include "FrameStream.h"
+
+FrameStream::FrameStream(Stream &stream) : in(stream) {
+  reset();
+}
+
+void FrameStream::reset() {
+  state = WAIT_START1;
+  length = 0;
+  received = 0;
+  check.reset();
+  memset(frames, 0, sizeof(frames));
+  back = 0;
+  fresh = false;
+  stop = false;
+  fade_end = 0;
+  fading = false;
+  taken = 0;
+  bad = 0;
+  dropped = 0;
+  late = 0;
+}
+
+bool FrameStream::poll() {
+  bool ready = false;
+  while (in.available() > 0) {
+    if (parse(in.read())) {
+      ready = true;
+    }
+  }
+  return ready;
+}
+
+const StreamFrame &FrameStream::take(unsigned long now) {
+  const StreamFrame &frame = frames[back ^ 1];
+  if (fading && (long)(now - fade_end) > 0) {
+    late++;
+  }
+  fading = frame.fade > 0;
+  fade_end = now + frame.fade;
+  fresh = false;
+  taken++;
+  return frame;
+}
+
+// Throw away the frame in progress and wait for the next start
+void FrameStream::resync() {
+  bad++;
+  state = WAIT_START1;
+}
+
+/**
+ * Feed one byte to the parser. Returns true when it completes a good frame.
+ */
+bool FrameStream::parse(uint8_t c) {
+  StreamFrame &frame = frames[back];
+
+  switch (state) {
+  case WAIT_START1:
+    if (c == STREAM_START1) {
+      state = WAIT_START2;
+    }
+    return false;
+
+  case WAIT_START2:
+    if (c != STREAM_START2) {
+      state = c == STREAM_START1 ? WAIT_START2 : WAIT_START1;
+      return false;
+    }
+    state = LENGTH;
+    return false;
+
+  case LENGTH:
+    if (c != 0 && c != STREAM_VALUES && c != STREAM_VALUES + 2) {
+      resync();
+      return false;
+    }
+    length = c;
+    received = 0;
+    frame.fade = 0;
+    check.reset();
+    check.add(c);
+    state = length ? PAYLOAD : CHECK1;
+    return false;
+
+  case PAYLOAD:
+    if (received < STREAM_VALUES) {
+      frame.values[received] = c;
+    } else if (received == STREAM_VALUES) {
+      frame.fade = c;
+    } else {
+      frame.fade |= (uint16_t)c << 8;
+    }
+    check.add(c);
+    if (++received == length) {
+      state = CHECK1;
+    }
+    return false;
+
+  case CHECK1:
+    if (c != check.sum1) {
+      resync();
+      return false;
+    }
+    state = CHECK2;
+    return false;
+
+  case CHECK2:
+    if (c != check.sum2) {
+      resync();
+      return false;
+    }
+    state = WAIT_START1;
+    if (!length) {
+      stop = true;
+      return false;
+    }
+
+    // The new frame goes in front; if the one there was never taken, it's dropped
+    if (fresh) {
+      dropped++;
+    }
+    back ^= 1;
+    fresh = true;
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,124 @@
+/*
+ * FrameStream.h
+ *
+ * Reads the shelf frames a PC streams to the stream program (Program4) on the
+ * USB serial port, so it can drive the shelves at 60 frames a second or more:
+ *
+ *   0xA5 0x5A   Start of a frame
+ *   LENGTH      Bytes of payload: STREAM_VALUES, STREAM_VALUES + 2 with a fade
+ *               time, or 0 for "stop streaming"
+ *   PAYLOAD     A value (0 - 255) for each shelf LED, shelf by shelf in R, G, B
+ *               order, then the fade time in milliseconds (little endian), if any
+ *   CHECK       Fletcher-16 of LENGTH and PAYLOAD: the sum, then the sum of sums
+ *
+ * A 12 LED frame with a fade is 19 bytes, so 115200 baud carries 600 a second.
+ *
+ * poll() consumes every byte that has arrived, one at a time, decoding each
+ * straight into the back one of two frames. Once a frame's check matches the
+ * two are swapped, so the front frame is always a whole, good one; a frame
+ * that doesn't check out is thrown away and the parser waits for the next
+ * start. take() hands the front frame to the program, once.
+ *
+ * Counted along the way: frames that were bad, frames dropped because a newer
+ * one came in before the last was taken, and frames that were late: taken
+ * after the fade of the frame before had already ended, so the shelves sat
+ * still waiting for them.
+ */
+
+#ifndef FrameStream_H_
+#define FrameStream_H_
+
+#include "Arduino.h"
+
+// Values in a frame (SHELVES * RGB)
+#define STREAM_VALUES 12
+
+// The bytes that start a frame
+#define STREAM_START1 0xA5
+#define STREAM_START2 0x5A
+
+// Fletcher-16 of the bytes added to it
+struct StreamCheck {
+  uint8_t sum1;
+  uint8_t sum2;
+
+  void reset() { sum1 = 0; sum2 = 0; }
+
+  void add(uint8_t c) {
+    uint16_t s = sum1 + c;
+    sum1 = s >= 255 ? s - 255 : s;
+    s = sum2 + sum1;
+    sum2 = s >= 255 ? s - 255 : s;
+  }
+};
+
+struct StreamFrame {
+  uint8_t values[STREAM_VALUES];
+  uint16_t fade;  // Milliseconds to fade to the values in, 0 to set them
+};
+
+class FrameStream {
+  Stream &in;
+
+  // Where we are in the frame
+  enum State {
+    WAIT_START1, // Waiting for 0xA5
+    WAIT_START2, // Waiting for 0x5A
+    LENGTH,
+    PAYLOAD,
+    CHECK1,
+    CHECK2
+  };
+  State state;
+  uint8_t length;
+  uint8_t received;
+  StreamCheck check;
+
+  // The frame being decoded into is frames[back], the last whole one frames[back ^ 1]
+  StreamFrame frames[2];
+  uint8_t back;
+
+  // The front frame hasn't been taken yet
+  bool fresh;
+
+  // A stop frame came in
+  bool stop;
+
+  // When the fade of the frame taken last ends
+  unsigned long fade_end;
+  bool fading;
+
+  unsigned long taken;
+  unsigned long bad;
+  unsigned long dropped;
+  unsigned long late;
+
+  // Handle one byte. Returns TRUE when it completes a good frame.
+  bool parse(uint8_t c);
+
+  // Throw away the frame in progress and wait for the next start
+  void resync();
+
+public:
+  FrameStream(Stream &stream);
+
+  // Forget the frame in progress, the frames and the counts
+  void reset();
+
+  // Decode every byte that has arrived. Returns TRUE if there's a new frame to take().
+  bool poll();
+
+  // The newest frame, shown at a point in time (millis()). It stays put until the next poll().
+  const StreamFrame &take(unsigned long now);
+
+  // Returns TRUE once a stop frame has come in
+  bool stopped() { return stop; }
+
+  // Frames taken, bad, dropped before they were taken, and taken late
+  unsigned long get_frames() { return taken; }
+  unsigned long get_bad() { return bad; }
+  unsigned long get_dropped() { return dropped; }
+  unsigned long get_late() { return late; }
+};
+
+#endif /* FrameStream_H_ */
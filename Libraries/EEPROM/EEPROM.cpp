@@ -47,4 +47,18 @@ void EEPROMClass::write(int address, uint8_t value)
 	eeprom_write_byte((unsigned char *) address, value);
 }
 
+// Only write the byte if it's different, saving the time and a write cycle of the cell
+void EEPROMClass::update(int address, uint8_t value)
+{
+	if (read(address) != value) {
+		write(address, value);
+	}
+}
+
+// True if the last write has finished, so reading or writing now won't block
+bool EEPROMClass::ready()
+{
+	return eeprom_is_ready();
+}
+
 EEPROMClass EEPROM;
@@ -7,33 +7,42 @@
 
 #include "Curve.h"
 
-// If this wasn't in program memory, we'd run out of SRAM way to fast.
-const uint8_t Curve::etable[256] PROGMEM = {
-   0,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,
-   1,  1,  1,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
-   2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  3,  3,  3,  3,  3,
-   3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  4,  4,  4,  4,  4,  4,
-   4,  4,  4,  4,  4,  4,  5,  5,  5,  5,  5,  5,  5,  5,  5,  6,
-   6,  6,  6,  6,  6,  6,  6,  7,  7,  7,  7,  7,  7,  8,  8,  8,
-   8,  8,  8,  9,  9,  9,  9,  9, 10, 10, 10, 10, 10, 11, 11, 11,
-  11, 12, 12, 12, 12, 13, 13, 13, 14, 14, 14, 14, 15, 15, 15, 16,
-  16, 16, 17, 17, 18, 18, 18, 19, 19, 20, 20, 21, 21, 21, 22, 22,
-  23, 23, 24, 24, 25, 25, 26, 27, 27, 28, 28, 29, 30, 30, 31, 32,
-  32, 33, 34, 35, 35, 36, 37, 38, 39, 39, 40, 41, 42, 43, 44, 45,
-  46, 47, 48, 49, 50, 51, 52, 53, 55, 56, 57, 58, 59, 61, 62, 63,
-  65, 66, 68, 69, 71, 72, 74, 76, 77, 79, 81, 82, 84, 86, 88, 90,
-  92, 94, 96, 98,100,102,105,107,109,112,114,117,119,122,124,127,
- 130,133,136,139,142,145,148,151,155,158,162,165,169,172,176,180,
- 184,188,192,196,201,205,210,214,219,224,229,234,239,244,250,255,
-};
+// The tables are worked out in double, which avr-gcc makes a float, so check the AVR build
+// comes out with the same entries: the ends and middle of the old hand-pasted etable, where
+// it steps up from 1, 2 and 16, and the entries closest to rounding the other way.
+static_assert(CurveMath::ExponentialSteps::value(0) == 0, "etable[0]");
+static_assert(CurveMath::ExponentialSteps::value(1) == 1, "etable[1]");
+static_assert(CurveMath::ExponentialSteps::value(18) == 1, "etable[18]");
+static_assert(CurveMath::ExponentialSteps::value(19) == 2, "etable[19]");
+static_assert(CurveMath::ExponentialSteps::value(42) == 2, "etable[42] (2.491)");
+static_assert(CurveMath::ExponentialSteps::value(43) == 3, "etable[43]");
+static_assert(CurveMath::ExponentialSteps::value(127) == 16, "etable[127]");
+static_assert(CurveMath::ExponentialSteps::value(128) == 16, "etable[128]");
+static_assert(CurveMath::ExponentialSteps::value(129) == 16, "etable[129] (16.498)");
+static_assert(CurveMath::ExponentialSteps::value(130) == 17, "etable[130]");
+static_assert(CurveMath::ExponentialSteps::value(139) == 21, "etable[139] (20.502)");
+static_assert(CurveMath::ExponentialSteps::value(168) == 39, "etable[168] (38.502)");
+static_assert(CurveMath::ExponentialSteps::value(254) == 250, "etable[254]");
+static_assert(CurveMath::ExponentialSteps::value(255) == 255, "etable[255]");
 
+// The 16-bit tables: the ends, and the middle of the curve (257 * sqrt(255), 255 * 0.502 ^ 2.2)
+static_assert(CurveMath::ExponentialSteps16::value(0) == 0, "exponential16 start");
+static_assert(CurveMath::ExponentialSteps16::value(128) == 4104, "exponential16 middle");
+static_assert(CurveMath::ExponentialSteps16::value(256) == 65535, "exponential16 end");
+static_assert(CurveMath::GammaSteps<220>::value(0) == 0, "gamma 2.2 start");
+static_assert(CurveMath::GammaSteps<220>::value(128) == 56, "gamma 2.2 middle");
+static_assert(CurveMath::GammaSteps<220>::value(255) == 255, "gamma 2.2 end");
+static_assert(CurveMath::GammaSteps16<220>::value(0) == 0, "gamma 2.2 16-bit start");
+static_assert(CurveMath::GammaSteps16<220>::value(256) == 65535, "gamma 2.2 16-bit end");
 
 uint8_t Curve::exponential(uint8_t i) {
- // If the compiler could build the above table for us, we could have "simply":
- //return !i ? 0 : round(exp(log(MAXOUTPUT) * i / MAXINPUT));
- 
- // Need to read the table in a special way!
- return pgm_read_byte(&etable[i]);
+ // The compiler builds this table for us (see CurveMath::ExponentialSteps), and it
+ // lives in program memory so we don't run out of SRAM (see ExponentialCurve)
+ return ExponentialCurve::apply(i);
+}
+
+uint16_t Curve::exponential16(uint16_t level) {
+ return ExponentialCurve::apply16(level);
 }
 
 uint8_t Curve::linear(uint8_t i) {
@@ -1,4 +1,4 @@
-/* 
+/*
  * File:   Curve.h
  * Author: cameron
  *
@@ -11,12 +11,188 @@
 #include <avr/pgmspace.h>
 
 class Curve {
- static const uint8_t etable[] PROGMEM;
 public:
  static uint8_t exponential(uint8_t);
+ static uint16_t exponential16(uint16_t);
  static uint8_t linear(uint8_t);
  static uint8_t reverse(uint8_t);
 };
 
-#endif	/* CURVE_H */
+/*
+ * Compile time curve tables
+ * -------------------------
+ * The math below is all constexpr, so the compiler builds each 256 entry
+ * table itself and it goes straight into PROGMEM. Nothing runs at startup.
+ */
+namespace CurveMath {
+  constexpr double LN2 = 0.69314718055994530942;
+
+  // atanh(z) = z + z^3/3 + z^5/5 + ...
+  constexpr double atanh_series(double z2, double term, int k) {
+    return k > 30 ? 0 : term / (2 * k + 1) + atanh_series(z2, term * z2, k + 1);
+  }
+
+  // ln(x) = 2 * atanh((x - 1) / (x + 1)), after halving/doubling x into [0.5, 1]
+  constexpr double ln_reduced(double z) {
+    return 2 * atanh_series(z * z, z, 0);
+  }
+  constexpr double ln(double x) {
+    return x < 0.5 ? ln(x * 2) - LN2 : (x > 1 ? ln(x / 2) + LN2 : ln_reduced((x - 1) / (x + 1)));
+  }
+
+  // e^y = 1 + y + y^2/2! + ..., after halving y into [-0.5, 0.5] and squaring back up
+  constexpr double exp_series(double y, double term, int k) {
+    return k > 20 ? 0 : term + exp_series(y, term * y / (k + 1), k + 1);
+  }
+  constexpr double square(double v) {
+    return v * v;
+  }
+  constexpr double exp(double y) {
+    return (y < -0.5 || y > 0.5) ? square(exp(y / 2)) : exp_series(y, 1, 0);
+  }
+
+  constexpr uint8_t round8(double v) {
+    return v <= 0 ? 0 : (v >= 255 ? 255 : (uint8_t)(v + 0.5));
+  }
+  constexpr uint16_t round16(double v) {
+    return v <= 0 ? 0 : (v >= 65535 ? 65535 : (uint16_t)(v + 0.5));
+  }
+
+  // 0, 1, ..., N - 1 as a template parameter pack
+  template <uint8_t... I> struct Indices {};
+  template <unsigned N, uint8_t... I> struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
+  template <uint8_t... I> struct MakeIndices<0, I...> { typedef Indices<I...> type; };
+  template <uint16_t... I> struct Indices16 {};
+  template <unsigned N, uint16_t... I> struct MakeIndices16 : MakeIndices16<N - 1, N - 1, I...> {};
+  template <uint16_t... I> struct MakeIndices16<0, I...> { typedef Indices16<I...> type; };
+
+  // A 256 entry PROGMEM table holding Steps::value(0) ... Steps::value(255)
+  template <class Steps, class Idx = typename MakeIndices<256>::type> struct Table;
+  template <class Steps, uint8_t... I> struct Table<Steps, Indices<I...> > {
+    static const uint8_t values[256] PROGMEM;
+  };
+  template <class Steps, uint8_t... I>
+  const uint8_t Table<Steps, Indices<I...> >::values[256] PROGMEM = { Steps::value(I)... };
+
+  // A 257 entry PROGMEM table of 16-bit values, Steps::value(0) ... Steps::value(256), for
+  // interpolating 16-bit inputs: input x is between entries x / 256 and x / 256 + 1
+  template <class Steps, class Idx = typename MakeIndices16<257>::type> struct Table16;
+  template <class Steps, uint16_t... I> struct Table16<Steps, Indices16<I...> > {
+    static const uint16_t values[257] PROGMEM;
+  };
+  template <class Steps, uint16_t... I>
+  const uint16_t Table16<Steps, Indices16<I...> >::values[257] PROGMEM = { Steps::value(I)... };
+
+  // Look x up in a Table16, interpolating between its entries
+  inline uint16_t interpolate(const uint16_t *table, uint16_t x) {
+    uint8_t i = x >> 8;
+    uint16_t a = pgm_read_word(&table[i]);
+    uint16_t b = pgm_read_word(&table[i + 1]);
+    return a + (((uint32_t)(b - a) * (x & 0xFF)) >> 8);
+  }
+
+  // round(exp(log(255) * i / 255)), the curve Curve::exponential has always used
+  struct ExponentialSteps {
+    static constexpr uint8_t value(uint8_t i) {
+      return !i ? 0 : round8(exp(ln(255) * i / 255));
+    }
+  };
+
+  // round(257 * exp(log(255) * i / 256)), the same curve for a Table16
+  struct ExponentialSteps16 {
+    static constexpr uint16_t value(uint16_t i) {
+      return !i ? 0 : (i >= 256 ? 65535 : round16(257 * exp(ln(255) * i / 256)));
+    }
+  };
+
+  // round(255 * (i / 255) ^ (GAMMA / 100))
+  template <uint16_t GAMMA> struct GammaSteps {
+    static constexpr uint8_t value(uint8_t i) {
+      return !i ? 0 : round8(255 * exp(GAMMA / 100.0 * ln(i / 255.0)));
+    }
+  };
+
+  // round(65535 * (i / 256) ^ (GAMMA / 100)), for a Table16
+  template <uint16_t GAMMA> struct GammaSteps16 {
+    static constexpr uint16_t value(uint16_t i) {
+      return !i ? 0 : (i >= 256 ? 65535 : round16(65535 * exp(GAMMA / 100.0 * ln(i / 256.0))));
+    }
+  };
+}
+
+/**
+ * Gamma curve: out = 255 * (in / 255) ^ (GAMMA / 100), so GammaCurve<220> is a gamma of 2.2
+ * apply16() is the same curve from 16-bit levels to 16-bit duty cycles (0 - 65535), which keeps
+ * the bottom of the curve apart: 8-bit, the first 20 or so values of a gamma of 2.2 are all 0 or 1.
+ */
+template <uint16_t GAMMA>
+struct GammaCurve {
+  static uint8_t apply(uint8_t value) {
+    return pgm_read_byte(&CurveMath::Table<CurveMath::GammaSteps<GAMMA> >::values[value]);
+  }
+  static uint16_t apply16(uint16_t level) {
+    return CurveMath::interpolate(CurveMath::Table16<CurveMath::GammaSteps16<GAMMA> >::values, level);
+  }
+};
 
+/**
+ * No curve: the duty cycle is the level, as Curve::linear
+ */
+struct LinearCurve {
+  static uint8_t apply(uint8_t value) { return value; }
+  static uint16_t apply16(uint16_t level) { return level; }
+};
+
+/**
+ * Curve::exponential. apply16() reads it from a 16-bit table, which keeps the bottom of the
+ * curve apart: 8-bit, everything from 1 to 18 comes out as 1.
+ */
+struct ExponentialCurve {
+  static uint8_t apply(uint8_t value) {
+    return pgm_read_byte(&CurveMath::Table<CurveMath::ExponentialSteps>::values[value]);
+  }
+  static uint16_t apply16(uint16_t level) {
+    return CurveMath::interpolate(CurveMath::Table16<CurveMath::ExponentialSteps16>::values, level);
+  }
+};
+
+/*
+ * Output curves for a FaderBank
+ * -----------------------------
+ * The bank calls apply(lane, level) for every level it writes to a pin, where
+ * lane is the channel's position within its group (0 - 2 for R, G, B). Levels
+ * and the duty cycles returned are 16-bit (value v is level v * 257). The bank
+ * holds the curve by value and calls it directly, so a curve with no state is
+ * inlined away. Curves used with UniformCurve and RGBCurve need an apply16().
+ */
+
+// A function picked at runtime, or no curve at all while it's NULL.
+// The functions are 8-bit, so with one set only the top 8 bits of a level count. For the
+// curve at 16 bits, use a policy instead, such as UniformCurve<ExponentialCurve>.
+struct FunctionCurve {
+  typedef uint8_t (*function)(uint8_t);
+  function fn;
+
+  FunctionCurve() : fn((function)0) {}
+  uint16_t apply(uint8_t, uint16_t level) {
+    return fn ? fn(level >> 8) * 257 : level;
+  }
+};
+
+// The same curve on every channel
+template <class C>
+struct UniformCurve {
+  uint16_t apply(uint8_t, uint16_t level) { return C::apply16(level); }
+};
+
+// A curve for each color of an RGB group
+template <class R, class G, class B>
+struct RGBCurve {
+  uint16_t apply(uint8_t lane, uint16_t level) {
+    if (lane == 0) return R::apply16(level);
+    if (lane == 1) return G::apply16(level);
+    return B::apply16(level);
+  }
+};
+
+#endif	/* CURVE_H */
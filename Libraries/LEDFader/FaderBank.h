@@ -0,0 +1,1026 @@
+/*
+ * FaderBank.h
+ *
+ * A fixed set of LED channels faded together. The channels are arranged in
+ * GROUPS groups of WIDTH channels (for example 4 shelves of R, G and B), and
+ * channel n of group g is channel g * WIDTH + n.
+ *
+ * The fade state of every channel lives in parallel arrays, one per field,
+ * and update() samples the time once and only visits the channels whose bit
+ * is set in the active mask. Fades use the same integer step schedule as
+ * LEDFader, on 16-bit levels.
+ *
+ * Values are 8-bit (0 - 255) on the outside, but each channel's level is
+ * 16-bit (value v is level v * 257), so a fade takes as many steps as its
+ * time allows even when it only has a few values to go: 0 to 30 over two
+ * seconds is 100 steps, not 30.
+ *
+ * CURVE maps each channel's level to the 16-bit duty cycle for its pin (see
+ * Curve.h). The default, FunctionCurve, takes a function with set_curve().
+ * PIN_OUT writes it out at the resolution the pin has (see PWMOutput.h):
+ * AnalogOutput (the default) has 8 bits, TimerOutput 12 on the 16-bit timers.
+ *
+ * Channels on 8-bit pins can be dithered (set_dither()): update() adds up the
+ * DITHER_BITS below the 8-bit duty cycle every DITHER_INTERVAL, sigma-delta
+ * style, and moves the pin up one duty for the frames where they carry. A
+ * level a third of the way from 2 to 3 comes out as 2, 2, 3, 2, 2, 3, ...
+ */
+
+#ifndef FaderBank_H_
+#define FaderBank_H_
+
+#include "Arduino.h"
+#include "Curve.h"
+#include "HSV.h"
+#include "PWMOutput.h"
+
+// The minimum time (milliseconds) the program will wait between LED adjustments, unless
+// changed with set_min_interval(). Adjust this to modify performance.
+#ifndef MIN_INTERVAL
+#define MIN_INTERVAL 20
+#endif
+
+// Dithered channels get DITHER_BITS more than their pin's 8 bits, and change duty cycle at most
+// once every DITHER_INTERVAL milliseconds, so a frame covers at least one period of
+// analogWrite()'s 490 Hz. The slowest pattern, 1 frame in 1 << DITHER_BITS, repeats every 32ms.
+#ifndef DITHER_BITS
+#define DITHER_BITS 4
+#endif
+#ifndef DITHER_INTERVAL
+#define DITHER_INTERVAL 2
+#endif
+
+// A byte of channel bits is enough for a bank of up to 8 channels
+template <bool SMALL> struct FaderBankMask { typedef uint16_t type; };
+template <> struct FaderBankMask<true> { typedef uint8_t type; };
+
+template <uint8_t GROUPS, uint8_t WIDTH = 1, class CURVE = FunctionCurve, uint8_t QUEUE = 2, class PIN_OUT = AnalogOutput>
+class FaderBank {
+public:
+  enum { CHANNELS = GROUPS * WIDTH };
+  static_assert(CHANNELS <= 16, "a FaderBank has at most 16 channels");
+  static_assert(QUEUE >= 1, "a FaderBank queues at least one fade per channel");
+
+  // One bit per channel, channel 0 in the lowest bit
+  typedef typename FaderBankMask<CHANNELS <= 8>::type mask_t;
+
+  // Function for set_curve(), when CURVE is a FunctionCurve
+  typedef FunctionCurve::function curve_function;
+
+  // Function for on_finished(), called with the channels that just finished fading
+  typedef void (*finished_function)(mask_t channels);
+
+private:
+  uint8_t pin[CHANNELS];
+
+  // Each channel's 16-bit level, and the values its fade started from and is going to
+  uint16_t color[CHANNELS];
+  uint8_t from_color[CHANNELS];
+  uint8_t to_color[CHANNELS];
+
+  // The step schedule worked out by fade(). The fade is split into frame_count frames
+  // of frame_time ms that each move the level by frame_step. The remainders of those
+  // divisions are spread across the frames with error accumulators (Bresenham style),
+  // so update() only adds and compares and the fade lands exactly on to_color exactly
+  // when it's due.
+  unsigned long next_step_time[CHANNELS];
+  unsigned long end_time[CHANNELS];
+  uint16_t frames[CHANNELS];
+  uint16_t frame_count[CHANNELS];
+  unsigned int frame_time[CHANNELS];
+  uint16_t time_remainder[CHANNELS];
+  uint16_t time_error[CHANNELS];
+  uint16_t frame_step[CHANNELS];
+  uint16_t step_remainder[CHANNELS];
+  uint16_t step_error[CHANNELS];
+
+  // Channels with a fade in progress
+  mask_t active;
+
+  // Fades waiting to start on each channel when the one in progress ends (see queue())
+  uint8_t queue_value[CHANNELS][QUEUE];
+  unsigned int queue_time[CHANNELS][QUEUE];
+  uint16_t queue_steps[CHANNELS][QUEUE];
+  uint8_t queue_count[CHANNELS];
+
+  // Channels that reached their target (with nothing left queued) since the last update(),
+  // and the ones that did by the last update(), which finished() reports
+  mask_t ending;
+  mask_t ended;
+  finished_function finished_callback;
+
+  // What was last written to each pin: the level, and what it came out as after the curve at
+  // the pin's resolution. A channel's bit in synced is set once its pin has been written,
+  // so the cache can be trusted.
+  uint16_t written_color[CHANNELS];
+  uint16_t duty[CHANNELS];
+  mask_t synced;
+
+  // Dithered channels: the 8-bit duty cycle each one's level is above, the DITHER_BITS
+  // fraction it's above it by, and the fraction carried over from the frames so far
+  mask_t dither;
+  uint8_t dither_base[CHANNELS];
+  uint8_t dither_fraction[CHANNELS];
+  uint8_t dither_error[CHANNELS];
+  unsigned long next_dither_time;
+
+  // Channels stepped by update() that still have to be written out by flush()
+  mask_t dirty;
+
+  // Shortest time between two steps of a fade (milliseconds)
+  unsigned int min_interval;
+
+  // How many pin writes were made and how many were skipped because nothing changed
+  unsigned long writes;
+  unsigned long elided;
+
+  CURVE curve;
+
+  // Work out the step schedule for a channel from its current color to to_color, in a
+  // number of steps (0 to work out its own from how far it has to go)
+  void plan(uint8_t ch, unsigned long now, unsigned long time, uint16_t steps = 0);
+
+  // Fade a channel to a value in a number of steps (0 for its own), from now
+  void start(uint8_t ch, uint8_t value, unsigned int time, uint16_t steps, unsigned long now);
+
+  // The steps for a group to fade from WIDTH levels to WIDTH values with every channel
+  // stepping together: as many as the channel going furthest takes on its own.
+  // 0 if none of them has anywhere to go.
+  uint16_t group_steps(const uint16_t *from, const uint8_t *to, unsigned long time);
+
+  // The steps for a group's fades in progress (the channels ending with the first one fading)
+  // to take a time, all together. 0 if they have nowhere to go.
+  uint16_t group_steps_left(uint8_t group, unsigned long time);
+
+  // Returns TRUE if retarget() would change anything on a channel
+  bool retargets(uint8_t ch, uint8_t value, unsigned int time, unsigned long now) {
+    if (!(active & bit(ch))) return level(value) != color[ch] || queue_count[ch];
+    return value != to_color[ch] || time < remaining(ch, now);
+  }
+
+  // When a channel's fade took its last step, for a retarget to plan from (now, if it isn't
+  // fading or the next step is already late)
+  unsigned long last_step_time(uint8_t ch, unsigned long now) {
+    if (!(active & bit(ch))) return now;
+    unsigned long last = next_step_time[ch] - frame_time[ch];
+    if ((long)(now - last) < 0 || (long)(now - next_step_time[ch]) >= 0) return now;
+    return last;
+  }
+
+  // Retarget a channel in a number of steps (0 for its own), planned from the time of its
+  // last step so the fade still ends time ms from now
+  void steer(uint8_t ch, uint8_t value, unsigned int time, uint16_t steps, unsigned long now, unsigned long last_step);
+
+  // Add a fade to a channel's queue, in a number of steps (0 for its own)
+  void enqueue(uint8_t ch, uint8_t value, unsigned int time, uint16_t steps);
+
+  // The level a channel will be at once its fade, and every fade queued after it, is done
+  uint16_t final_level(uint8_t ch) {
+    if (queue_count[ch]) return level(queue_value[ch][queue_count[ch] - 1]);
+    return (active & bit(ch)) ? level(to_color[ch]) : color[ch];
+  }
+
+  // Most steps in a fade, so the error terms can't overflow
+  enum { MAX_STEPS = 0x7FFF };
+
+  // Move a channel's next_step_time to the end of its next frame
+  void schedule_frame(uint8_t ch);
+
+  // Take every step of a channel's fade that is due by now
+  void step(uint8_t ch, unsigned long now);
+
+  // Stop a channel's fade, leaving its queue alone
+  void halt(uint8_t ch) { active &= ~bit(ch); frames[ch] = 0; }
+
+  // Start a channel's next queued fade at the time the last one ended
+  void next_fade(uint8_t ch);
+
+  // Fade or queue a group through hues, as a fade per sector of the color wheel
+  bool hue_fade(uint8_t group, const uint8_t *values, unsigned int time, bool queued);
+
+  // Write a channel's color to its pin, unless the pin already has that duty cycle
+  void write(uint8_t ch);
+
+  // Write a level from PIN_OUT::level() to a channel's pin, unless it's already there
+  void output(uint8_t ch, uint16_t d);
+
+  // Move every dithered channel on to its next frame
+  void dither_frame();
+
+  // Milliseconds left until a channel's fade is due to end
+  unsigned long remaining(uint8_t ch, unsigned long now) {
+    return ((long)(end_time[ch] - now) > 0) ? end_time[ch] - now : 0;
+  }
+
+  static mask_t bit(uint8_t ch) { return (mask_t)1 << ch; }
+
+  // The 16-bit level of a value (0 - 255 to 0 - 65535)
+  static uint16_t level(uint8_t value) { return (uint16_t)value << 8 | value; }
+
+public:
+
+  // Create a bank with every channel on pin 0 (no output)
+  FaderBank();
+
+  // Create a bank from a list of CHANNELS pins, in channel order
+  FaderBank(const uint8_t *pins);
+
+  // Set the PWM pin a channel is connected to
+  void set_pin(uint8_t ch, uint8_t pwm_pin) {
+    pin[ch] = pwm_pin;
+    synced &= ~bit(ch);
+    if (dither & bit(ch)) {
+      set_dither(ch, true);
+    }
+  }
+  uint8_t get_pin(uint8_t ch) { return pin[ch]; }
+
+  // Set the shortest time between two steps of a fade (milliseconds, MIN_INTERVAL by default).
+  // Fades already in progress keep the schedule they have.
+  void set_min_interval(unsigned int ms) { min_interval = ms ? ms : 1; }
+  unsigned int get_min_interval() { return min_interval; }
+
+  // Dither a channel between the duty cycles either side of its level (see the top of the
+  // file). Only channels on 8-bit pins are dithered; the others have the bits already.
+  void set_dither(uint8_t ch, bool on) {
+    if (on && PIN_OUT::bits(pin[ch]) == 8) {
+      dither |= bit(ch);
+    } else {
+      dither &= ~bit(ch);
+    }
+    dither_error[ch] = 0;
+    synced &= ~bit(ch);
+  }
+  bool is_dithered(uint8_t ch) { return dither & bit(ch); }
+
+  // Set curve to transform output (NULL for none), when CURVE is a FunctionCurve
+  void set_curve(curve_function c) { curve.fn = c; }
+  curve_function get_curve() { return curve.fn; }
+
+  // Set a channel to an absolute PWM value, stopping any fade on it
+  void set_value(uint8_t ch, uint8_t value);
+
+  // Get the current PWM value of a channel
+  uint8_t get_value(uint8_t ch) { return color[ch] >> 8; }
+
+  // Get the current 16-bit level of a channel (value v is level v * 257)
+  uint16_t get_level(uint8_t ch) { return color[ch]; }
+
+  // Set the WIDTH channels of a group to absolute PWM values
+  void set_group(uint8_t group, const uint8_t *values);
+
+  // Fade a channel to a PWM value over a duration of time (milliseconds)
+  void fade(uint8_t ch, uint8_t value, unsigned int time);
+
+  // Fade the WIDTH channels of a group to PWM values. They share one step schedule, set by the
+  // channel going furthest, so they all step on the same update() and finish together, and
+  // the color stays on the line between where it started and where it's going.
+  void fade_group(uint8_t group, const uint8_t *values, unsigned int time);
+
+  // Fade every group to the same WIDTH PWM values
+  void fade_all(const uint8_t *values, unsigned int time);
+
+  // Change where a channel is fading to, and how long it has left to get there (milliseconds).
+  // A fade in progress keeps the rhythm of its steps instead of starting over, and asking
+  // for the target it already has (or is at) changes nothing unless the time is shorter than
+  // what's left, so it's cheap to call on every reading.
+  void retarget(uint8_t ch, uint8_t value, unsigned int time);
+
+  // Retarget the WIDTH channels of a group, or every group to the same WIDTH values
+  void retarget_group(uint8_t group, const uint8_t *values, unsigned int time);
+  void retarget_all(const uint8_t *values, unsigned int time);
+
+  // Add a fade to the channel's queue, to start the moment the fade before it ends, or now if
+  // the channel isn't fading (or when a fade() that had nothing to do would have ended).
+  // Fading to the value it will already be at holds it there for the time.
+  // Returns FALSE if the queue (QUEUE fades) is full. fade() and set_value() clear the queue.
+  bool queue(uint8_t ch, uint8_t value, unsigned int time);
+
+  // Queue a fade on the WIDTH channels of a group, or every group to the same WIDTH values,
+  // with the group's channels stepping together like fade_group()
+  // Returns FALSE (and queues nothing on the group) if any of the group's queues is full
+  bool queue_group(uint8_t group, const uint8_t *values, unsigned int time);
+  bool queue_all(const uint8_t *values, unsigned int time);
+
+  // Number of fades waiting in a channel's queue
+  uint8_t queued(uint8_t ch) { return queue_count[ch]; }
+
+  // The value a channel will be at once its fade, and every fade queued after it, is done
+  uint8_t get_final_value(uint8_t ch) { return final_level(ch) >> 8; }
+
+  // Fade or queue a group of R, G and B channels (WIDTH 3) to a color going round the color
+  // wheel (see HSV.h) instead of straight across RGB, so the colors in between keep their
+  // brightness and saturation. It's a chain of fades, one for each sector the hue passes
+  // through (up to 4), so it uses the queue; with too little room, the last fade it has room
+  // for goes straight to the color. queue_group_hue() returns FALSE if the queue is full.
+  void fade_group_hue(uint8_t group, const uint8_t *values, unsigned int time) {
+    hue_fade(group, values, time, false);
+  }
+  bool queue_group_hue(uint8_t group, const uint8_t *values, unsigned int time) {
+    return hue_fade(group, values, time, true);
+  }
+
+  // Stop the fade on a channel where it's at, and drop its queue (that isn't finishing it)
+  void stop_fade(uint8_t ch) { halt(ch); queue_count[ch] = 0; ending &= ~bit(ch); end_time[ch] = millis(); }
+
+  // Stop every fade where it's at
+  void stop_all();
+
+  // Channels with a fade in progress
+  mask_t fading() { return active; }
+
+  // Returns TRUE if a channel, or any channel of a group, is fading
+  bool is_fading(uint8_t ch) { return active & bit(ch); }
+  bool is_group_fading(uint8_t group) { return active & group_mask(group); }
+
+  // Channels whose fades (and every fade queued after them) finished during the last update().
+  // A fade to the value a channel already has finishes straight away. Stopping one doesn't.
+  mask_t finished() { return ended; }
+
+  // Returns TRUE if a channel finished in the last update(), or a group did: the last of its
+  // channels to be fading finished, so none of them is any more
+  bool is_finished(uint8_t ch) { return ended & bit(ch); }
+  bool is_group_finished(uint8_t group) {
+    return (ended & group_mask(group)) && !(active & group_mask(group));
+  }
+
+  // Have update() call a function with finished(), when there is something in it (NULL for none)
+  void on_finished(finished_function fn) { finished_callback = fn; }
+
+  // The channel bits of a group
+  static mask_t group_mask(uint8_t group) {
+    return (mask_t)((1 << WIDTH) - 1) << (group * WIDTH);
+  }
+
+  // Update every fading channel with the time sampled once by the caller, then flush()
+  // and report the fades that finished (see finished())
+  // Returns TRUE if any fade is still in process
+  bool update(unsigned long now);
+
+  // Write out every channel update() has changed, skipping pins whose duty cycle
+  // (after the curve) is the same as what they already have
+  void flush();
+
+  // Number of pin writes made, and skipped because the duty cycle hadn't changed
+  unsigned long get_writes() { return writes; }
+  unsigned long get_elided() { return elided; }
+  void reset_counters() { writes = 0; elided = 0; }
+
+  // Decrease/increase the speed of every running fade by a number of milliseconds
+  void slower(int by);
+  void faster(int by);
+
+  // Returns how much of a channel's fade is complete in a percentage between 0 - 100
+  uint8_t get_progress(uint8_t ch);
+};
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::FaderBank() {
+  for (uint8_t ch = 0; ch < CHANNELS; ch++) {
+    pin[ch] = 0;
+    color[ch] = 0;
+    from_color[ch] = 0;
+    to_color[ch] = 0;
+    frames[ch] = 0;
+    end_time[ch] = 0;
+    queue_count[ch] = 0;
+  }
+  active = 0;
+  ending = 0;
+  ended = 0;
+  finished_callback = 0;
+  synced = 0;
+  dither = 0;
+  next_dither_time = 0;
+  dirty = 0;
+  min_interval = MIN_INTERVAL;
+  writes = 0;
+  elided = 0;
+}
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::FaderBank(const uint8_t *pins) : FaderBank() {
+  for (uint8_t ch = 0; ch < CHANNELS; ch++) {
+    pin[ch] = pins[ch];
+  }
+}
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+void FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::write(uint8_t ch) {
+  if (!pin[ch]) return;
+  mask_t b = bit(ch);
+
+  // Same color as last time: no need to run the curve either
+  if ((synced & b) && written_color[ch] == color[ch]) {
+    elided++;
+    return;
+  }
+  written_color[ch] = color[ch];
+
+  uint16_t d = curve.apply(ch % WIDTH, color[ch]);
+  if (dither & b) {
+
+    // The 8-bit duty cycle and the fraction above it, which dither_frame() adds up
+    uint16_t fine = ((uint32_t)d * (255 << DITHER_BITS) + 0x8000) >> 16;
+    dither_base[ch] = fine >> DITHER_BITS;
+    dither_fraction[ch] = fine & ((1 << DITHER_BITS) - 1);
+    d = dither_base[ch];
+  } else {
+    d = PIN_OUT::level(pin[ch], d);
+  }
+  output(ch, d);
+}
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+void FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::output(uint8_t ch, uint16_t d) {
+  mask_t b = bit(ch);
+  if ((synced & b) && duty[ch] == d) {
+    elided++;
+    return;
+  }
+
+  duty[ch] = d;
+  synced |= b;
+  writes++;
+  PIN_OUT::write(pin[ch], d);
+}
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+void FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::dither_frame() {
+  mask_t pending = dither;
+  for (uint8_t ch = 0; pending; ch++, pending >>= 1) {
+    if ((pending & 1) && dither_fraction[ch] && pin[ch]) {
+      uint8_t e = dither_error[ch] + dither_fraction[ch];
+      dither_error[ch] = e & ((1 << DITHER_BITS) - 1);
+      output(ch, dither_base[ch] + (e >> DITHER_BITS));
+    }
+  }
+}
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+void FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::set_value(uint8_t ch, uint8_t value) {
+  stop_fade(ch);
+  color[ch] = level(value);
+  write(ch);
+}
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+void FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::set_group(uint8_t group, const uint8_t *values) {
+  uint8_t ch = group * WIDTH;
+  for (uint8_t i = 0; i < WIDTH; i++) {
+    set_value(ch + i, values[i]);
+  }
+}
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+void FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::fade(uint8_t ch, uint8_t value, unsigned int time) {
+  start(ch, value, time, 0, millis());
+}
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+void FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::start(uint8_t ch, uint8_t value, unsigned int time, uint16_t steps, unsigned long now) {
+  stop_fade(ch);
+
+  // No pin defined or color hasn't changed (unless it's keeping step with its group)
+  if (!pin[ch]) {
+    return;
+  }
+  if (level(value) == color[ch] && !steps) {
+    ending |= bit(ch);
+    end_time[ch] = now + time;
+    return;
+  }
+
+  from_color[ch] = color[ch] >> 8;
+  to_color[ch] = value;
+  plan(ch, now, time, steps);
+}
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+uint16_t FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::group_steps(const uint16_t *from, const uint8_t *to, unsigned long time) {
+  uint16_t furthest = 0;
+  for (uint8_t i = 0; i < WIDTH; i++) {
+    uint16_t target = level(to[i]);
+    uint16_t diff = (target > from[i]) ? target - from[i] : from[i] - target;
+    if (diff > furthest) {
+      furthest = diff;
+    }
+  }
+
+  // Step at most once every min_interval, and never by less than 1
+  unsigned long count = time / min_interval;
+  if (count > MAX_STEPS) {
+    count = MAX_STEPS;
+  }
+  return (count < furthest) ? (count ? count : 1) : furthest;
+}
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+void FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::fade_group(uint8_t group, const uint8_t *values, unsigned int time) {
+  uint8_t ch = group * WIDTH;
+
+  // Every channel of the group on the same schedule, from the same millisecond
+  unsigned long now = millis();
+  uint16_t steps = (WIDTH > 1) ? group_steps(&color[ch], values, time) : 0;
+  for (uint8_t i = 0; i < WIDTH; i++) {
+    start(ch + i, values[i], time, steps, now);
+  }
+}
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+void FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::fade_all(const uint8_t *values, unsigned int time) {
+  for (uint8_t group = 0; group < GROUPS; group++) {
+    fade_group(group, values, time);
+  }
+}
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+void FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::retarget(uint8_t ch, uint8_t value, unsigned int time) {
+  // Idle and already there, or the same target with at least as long left: nothing changes.
+  // (A longer time can't be told apart from the same call again a moment later, which would
+  // put the end off for ever.)
+  unsigned long now = millis();
+  if (!retargets(ch, value, time, now)) {
+    return;
+  }
+  steer(ch, value, time, 0, now, last_step_time(ch, now));
+}
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+void FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::steer(uint8_t ch, uint8_t value, unsigned int time, uint16_t steps, unsigned long now, unsigned long last_step) {
+  unsigned long span = now - last_step + time;
+  if (!(active & bit(ch))) {
+    start(ch, value, span, steps, last_step);
+    return;
+  }
+
+  // Already there
+  uint16_t c = color[ch];
+  uint16_t target = level(value);
+  if (target == c && !steps) {
+    halt(ch);
+    to_color[ch] = value;
+    ending |= bit(ch);
+    end_time[ch] = now;
+    next_fade(ch);
+    return;
+  }
+
+  // Turning around: progress counts from here
+  if ((target > c) != (level(to_color[ch]) > c)) {
+    from_color[ch] = c >> 8;
+  }
+  to_color[ch] = value;
+
+  // Plan the rest from the last step, so the next step comes about when it would have and
+  // the fade still ends in time from now
+  plan(ch, last_step, span, steps);
+}
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+void FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::retarget_group(uint8_t group, const uint8_t *values, unsigned int time) {
+  uint8_t ch = group * WIDTH;
+  unsigned long now = millis();
+  bool change = false;
+  for (uint8_t i = 0; i < WIDTH; i++) {
+    change |= retargets(ch + i, values[i], time, now);
+  }
+  if (!change) {
+    return;
+  }
+
+  // Every channel of the group on one new schedule, from the last step of the first one
+  // fading, so a group that was stepping together still does
+  unsigned long last_step = now;
+  for (uint8_t i = 0; i < WIDTH; i++) {
+    if (active & bit(ch + i)) {
+      last_step = last_step_time(ch + i, now);
+      break;
+    }
+  }
+  uint16_t steps = (WIDTH > 1) ? group_steps(&color[ch], values, time) : 0;
+  for (uint8_t i = 0; i < WIDTH; i++) {
+    steer(ch + i, values[i], time, steps, now, last_step);
+  }
+}
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+void FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::retarget_all(const uint8_t *values, unsigned int time) {
+  for (uint8_t group = 0; group < GROUPS; group++) {
+    retarget_group(group, values, time);
+  }
+}
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+void FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::stop_all() {
+  unsigned long now = millis();
+  for (uint8_t ch = 0; ch < CHANNELS; ch++) {
+    frames[ch] = 0;
+    end_time[ch] = now;
+    queue_count[ch] = 0;
+  }
+  active = 0;
+  ending = 0;
+}
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+void FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::plan(uint8_t ch, unsigned long now, unsigned long time, uint16_t steps) {
+  halt(ch);
+
+  if (time <= min_interval) {
+    color[ch] = level(to_color[ch]);
+    write(ch);
+    ending |= bit(ch);
+    end_time[ch] = now + time;
+    return;
+  }
+  ending &= ~bit(ch);
+
+  uint16_t c = color[ch];
+  uint16_t to = level(to_color[ch]);
+  uint16_t color_diff = (to > c) ? to - c : c - to;
+
+  // Step at most once every min_interval, and never by less than 1
+  // (nowhere to go is a hold: one step of 0 at the end)
+  unsigned long count = time / min_interval;
+  if (count > MAX_STEPS) {
+    count = MAX_STEPS;
+  }
+  if (count > color_diff) {
+    count = color_diff ? color_diff : 1;
+  }
+
+  // In step with the rest of its group: some of those steps are by 0
+  if (steps) {
+    count = steps;
+  }
+
+  frame_count[ch] = count;
+  frame_time[ch] = time / count;
+  time_remainder[ch] = time % count;
+  frame_step[ch] = color_diff / count;
+  step_remainder[ch] = color_diff % count;
+
+  // Start the error terms half way, so the extra milliseconds and steps are spread evenly
+  time_error[ch] = count / 2;
+  step_error[ch] = count / 2;
+
+  next_step_time[ch] = now;
+  end_time[ch] = now + time;
+  frames[ch] = count;
+  schedule_frame(ch);
+  active |= bit(ch);
+}
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+void FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::schedule_frame(uint8_t ch) {
+  next_step_time[ch] += frame_time[ch];
+  time_error[ch] += time_remainder[ch];
+  if (time_error[ch] >= frame_count[ch]) {
+    time_error[ch] -= frame_count[ch];
+    next_step_time[ch]++;
+  }
+}
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+void FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::step(uint8_t ch, unsigned long now) {
+  uint16_t value = color[ch];
+  bool up = level(to_color[ch]) > value;
+
+  // Take every step that's due (more than one if loop() ran late)
+  do {
+    uint16_t s = frame_step[ch];
+    step_error[ch] += step_remainder[ch];
+    if (step_error[ch] >= frame_count[ch]) {
+      step_error[ch] -= frame_count[ch];
+      s++;
+    }
+
+    if (up) {
+      value += s;
+    } else {
+      value -= s;
+    }
+
+    if (--frames[ch]) {
+      schedule_frame(ch);
+    } else {
+      active &= ~bit(ch);
+      ending |= bit(ch);
+    }
+  } while (frames[ch] && (long)(now - next_step_time[ch]) >= 0);
+
+  color[ch] = value;
+  dirty |= bit(ch);
+
+  // Go straight on to the next fade in the queue (catching up on it too, if it's due)
+  if (!frames[ch] && queue_count[ch]) {
+    next_fade(ch);
+    if ((active & bit(ch)) && (long)(now - next_step_time[ch]) >= 0) {
+      step(ch, now);
+    }
+  }
+}
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+void FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::next_fade(uint8_t ch) {
+  unsigned long start = end_time[ch];
+
+  // Fades too short to step are done as soon as they start
+  while (queue_count[ch] && !(active & bit(ch))) {
+    uint8_t value = queue_value[ch][0];
+    unsigned int time = queue_time[ch][0];
+    uint16_t steps = queue_steps[ch][0];
+    queue_count[ch]--;
+    for (uint8_t i = 0; i < queue_count[ch]; i++) {
+      queue_value[ch][i] = queue_value[ch][i + 1];
+      queue_time[ch][i] = queue_time[ch][i + 1];
+      queue_steps[ch][i] = queue_steps[ch][i + 1];
+    }
+
+    from_color[ch] = color[ch] >> 8;
+    to_color[ch] = value;
+    plan(ch, start, time, steps);
+    start += time;
+  }
+}
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+bool FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::queue(uint8_t ch, uint8_t value, unsigned int time) {
+  if (queue_count[ch] == QUEUE) {
+    return false;
+  }
+  enqueue(ch, value, time, 0);
+  return true;
+}
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+void FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::enqueue(uint8_t ch, uint8_t value, unsigned int time, uint16_t steps) {
+  if (!pin[ch]) {
+    return;
+  }
+  queue_value[ch][queue_count[ch]] = value;
+  queue_time[ch][queue_count[ch]] = time;
+  queue_steps[ch][queue_count[ch]] = steps;
+  queue_count[ch]++;
+
+  // Nothing to wait for, but a fade that had nothing to do (to where the channel already
+  // was) still takes its time, so a group's queued fades start together
+  if (!(active & bit(ch))) {
+    unsigned long now = millis();
+    if ((long)(end_time[ch] - now) < 0) {
+      end_time[ch] = now;
+    }
+    next_fade(ch);
+  }
+}
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+bool FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::hue_fade(uint8_t group, const uint8_t *values, unsigned int time, bool queued) {
+  static_assert(WIDTH == 3, "hue fades need groups of R, G and B channels");
+  uint8_t ch = group * WIDTH;
+
+  // Start from where the group is, or where its queue will leave it, and see how many
+  // fades there's room for (fade_group_hue() starts one straight away)
+  uint8_t start[WIDTH];
+  uint8_t room = QUEUE;
+  for (uint8_t i = 0; i < WIDTH; i++) {
+    if (queued) {
+      start[i] = get_final_value(ch + i);
+      if (QUEUE - queue_count[ch + i] < room) {
+        room = QUEUE - queue_count[ch + i];
+      }
+    } else {
+      start[i] = get_value(ch + i);
+    }
+  }
+  if (!room) {
+    return false;
+  }
+  if (!queued) {
+    room++;
+  }
+
+  HSV from, to;
+  rgb_to_hsv(start, from);
+  rgb_to_hsv(values, to);
+  hsv_match_hues(from, to);
+  int turn = hue_distance(from, to);
+  uint16_t total = turn < 0 ? -turn : turn;
+
+  uint16_t done = 0;
+  unsigned int time_done = 0;
+  uint16_t hue = from.h;
+  bool ok = true;
+  for (bool first = true; ; first = false) {
+
+    // On to the next sector boundary, or the end
+    uint8_t into = hue & (HUE_SECTOR - 1);
+    uint16_t sector_left = (turn > 0) ? HUE_SECTOR - into : (into ? into : HUE_SECTOR);
+    uint8_t rgb[WIDTH];
+    if (total - done <= sector_left || room == 1) {
+      done = total;
+      memcpy(rgb, values, WIDTH);
+    } else {
+      done += sector_left;
+      HSV at;
+      hsv_blend(from, to, done, total, at);
+      hsv_to_rgb(at, rgb);
+      hue = at.h;
+    }
+
+    // Each fade takes its share of the time (the last one what's left)
+    unsigned int t = total ? (unsigned long)time * done / total - time_done : time;
+    time_done += t;
+    if (first && !queued) {
+      fade_group(group, rgb, t);
+    } else {
+      ok &= queue_group(group, rgb, t);
+    }
+    room--;
+
+    if (done == total) {
+      return ok;
+    }
+  }
+}
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+bool FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::queue_group(uint8_t group, const uint8_t *values, unsigned int time) {
+  uint8_t ch = group * WIDTH;
+  uint16_t from[WIDTH];
+  for (uint8_t i = 0; i < WIDTH; i++) {
+    if (queue_count[ch + i] == QUEUE) {
+      return false;
+    }
+    from[i] = final_level(ch + i);
+  }
+
+  // Every channel of the group on the same schedule, from where they'll all be
+  uint16_t steps = (WIDTH > 1) ? group_steps(from, values, time) : 0;
+  for (uint8_t i = 0; i < WIDTH; i++) {
+    enqueue(ch + i, values[i], time, steps);
+  }
+  return true;
+}
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+bool FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::queue_all(const uint8_t *values, unsigned int time) {
+  bool ok = true;
+  for (uint8_t group = 0; group < GROUPS; group++) {
+    ok &= queue_group(group, values, time);
+  }
+  return ok;
+}
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+bool FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::update(unsigned long now) {
+  mask_t pending = active;
+  for (uint8_t ch = 0; pending; ch++, pending >>= 1) {
+    if ((pending & 1) && (long)(now - next_step_time[ch]) >= 0) {
+      step(ch, now);
+    }
+  }
+  if (dirty) {
+    flush();
+  }
+  if (dither && (long)(now - next_dither_time) >= 0) {
+    next_dither_time = now + DITHER_INTERVAL;
+    dither_frame();
+  }
+
+  // Nothing finished this time or last: nothing to report or clear
+  if (!(ending | ended)) {
+    return active != 0;
+  }
+  ended = ending;
+  ending = 0;
+  if (ended && finished_callback) {
+    finished_callback(ended);
+  }
+  return active != 0;
+}
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+void FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::flush() {
+  mask_t pending = dirty;
+  dirty = 0;
+  for (uint8_t ch = 0; pending; ch++, pending >>= 1) {
+    if (pending & 1) {
+      write(ch);
+    }
+  }
+}
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+uint16_t FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::group_steps_left(uint8_t group, unsigned long time) {
+  if (WIDTH == 1) {
+    return 0;
+  }
+
+  // Channels that aren't in step with the first one fading count as having nowhere to go
+  uint8_t ch = group * WIDTH;
+  uint16_t from[WIDTH];
+  uint8_t to[WIDTH];
+  unsigned long end = 0;
+  bool first = true;
+  for (uint8_t i = 0; i < WIDTH; i++) {
+    if ((active & bit(ch + i)) && (first || end_time[ch + i] == end)) {
+      end = end_time[ch + i];
+      first = false;
+      from[i] = color[ch + i];
+      to[i] = to_color[ch + i];
+    } else {
+      to[i] = color[ch + i] >> 8;
+      from[i] = level(to[i]);
+    }
+  }
+  return group_steps(from, to, time);
+}
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+void FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::slower(int by) {
+  unsigned long now = millis();
+  for (uint8_t group = 0; group < GROUPS; group++) {
+    if (!is_group_fading(group)) {
+      continue;
+    }
+
+    // Channels stepping together have the same time left, and keep stepping together
+    uint8_t ch = group * WIDTH;
+    uint16_t steps = 0;
+    bool planned = false;
+    unsigned long end = 0;
+    for (uint8_t i = 0; i < WIDTH; i++) {
+      if (!(active & bit(ch + i))) {
+        continue;
+      }
+      unsigned long time = remaining(ch + i, now) + by;
+      if (!planned) {
+        steps = group_steps_left(group, time);
+        end = end_time[ch + i];
+        planned = true;
+      }
+
+      // Stretch what's left of the fade, keeping the progress made so far
+      plan(ch + i, now, time, end_time[ch + i] == end ? steps : 0);
+    }
+  }
+}
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+void FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::faster(int by) {
+  unsigned long now = millis();
+  for (uint8_t group = 0; group < GROUPS; group++) {
+    if (!is_group_fading(group)) {
+      continue;
+    }
+
+    // Channels stepping together have the same time left, and keep stepping together
+    uint8_t ch = group * WIDTH;
+    uint16_t steps = 0;
+    bool planned = false;
+    unsigned long end = 0;
+    for (uint8_t i = 0; i < WIDTH; i++) {
+      if (!(active & bit(ch + i))) {
+        continue;
+      }
+      unsigned long left = remaining(ch + i, now);
+
+      // Ends the fade, and starts the next one queued
+      if (by < 0 || left <= (unsigned int)by) {
+        halt(ch + i);
+        color[ch + i] = level(to_color[ch + i]);
+        write(ch + i);
+        ending |= bit(ch + i);
+        end_time[ch + i] = now;
+        next_fade(ch + i);
+        continue;
+      }
+      if (!planned) {
+        steps = group_steps_left(group, left - by);
+        end = end_time[ch + i];
+        planned = true;
+      }
+      plan(ch + i, now, left - by, end_time[ch + i] == end ? steps : 0);
+    }
+  }
+}
+
+template <uint8_t GROUPS, uint8_t WIDTH, class CURVE, uint8_t QUEUE, class PIN_OUT>
+uint8_t FaderBank<GROUPS, WIDTH, CURVE, QUEUE, PIN_OUT>::get_progress(uint8_t ch) {
+  if (!(active & bit(ch))) {
+    return 100;
+  }
+  uint16_t from = level(from_color[ch]);
+  uint16_t to = level(to_color[ch]);
+  uint16_t c = color[ch];
+  uint16_t total = (to > from) ? to - from : from - to;
+  uint16_t done = (c > from) ? c - from : from - c;
+  if (!total) {
+    return 100;
+  }
+  return (unsigned long)done * 100 / total;
+}
+
+#endif /* FaderBank_H_ */
@@ -0,0 +1,105 @@
+/*
+ * HSV.cpp
+ *
+ * Integer HSV colors. See HSV.h
+ */
+
+#include "HSV.h"
+
+// Which of v, p, q and t (see hsv_to_rgb()) goes to R, G and B in each sector
+const uint8_t hsv_sectors[6][3] PROGMEM = {
+  { 0, 3, 1 }, // Red to yellow: G rises
+  { 2, 0, 1 }, // Yellow to green: R falls
+  { 1, 0, 3 }, // Green to cyan: B rises
+  { 1, 2, 0 }, // Cyan to blue: G falls
+  { 3, 1, 0 }, // Blue to magenta: R rises
+  { 0, 1, 2 }  // Magenta to red: B falls
+};
+
+// a * b / 255, near enough (exact for b = 0 and b = 255)
+static inline uint8_t scale(uint8_t a, uint8_t b) {
+  return ((uint16_t)a * (b + 1)) >> 8;
+}
+
+void hsv_to_rgb(const HSV &hsv, uint8_t *rgb) {
+  uint8_t sector = hsv.h >> 8;
+  uint8_t f = hsv.h & 0xFF;
+
+  // The brightest channel, the darkest, and the one falling / rising across the sector
+  uint8_t values[4];
+  values[0] = hsv.v;
+  values[1] = scale(hsv.v, 255 - hsv.s);
+  values[2] = scale(hsv.v, 255 - scale(hsv.s, f));
+  values[3] = scale(hsv.v, 255 - scale(hsv.s, 255 - f));
+
+  const uint8_t *order = hsv_sectors[sector < 6 ? sector : 0];
+  for (uint8_t c = 0; c < 3; c++) {
+    rgb[c] = values[pgm_read_byte(&order[c])];
+  }
+}
+
+void rgb_to_hsv(const uint8_t *rgb, HSV &hsv) {
+  uint8_t r = rgb[0], g = rgb[1], b = rgb[2];
+  uint8_t max = r > g ? (r > b ? r : b) : (g > b ? g : b);
+  uint8_t min = r < g ? (r < b ? r : b) : (g < b ? g : b);
+  uint8_t delta = max - min;
+
+  hsv.v = max;
+  if (!delta) {
+    hsv.s = 0;
+    hsv.h = 0;
+    return;
+  }
+  hsv.s = (uint16_t)delta * 255 / max;
+
+  // Where between the two sectors either side of the brightest channel
+  long h;
+  if (max == r) {
+    h = (long)((int)g - b) * HUE_SECTOR / delta;
+  } else if (max == g) {
+    h = 2 * HUE_SECTOR + (long)((int)b - r) * HUE_SECTOR / delta;
+  } else {
+    h = 4 * HUE_SECTOR + (long)((int)r - g) * HUE_SECTOR / delta;
+  }
+  if (h < 0) {
+    h += HUE_RANGE;
+  }
+  hsv.h = h < HUE_RANGE ? h : HUE_RANGE - 1;
+}
+
+void hsv_match_hues(HSV &from, HSV &to) {
+  if (!from.s || !from.v) {
+    from.h = to.h;
+  }
+  if (!to.s || !to.v) {
+    to.h = from.h;
+  }
+}
+
+int hue_distance(const HSV &from, const HSV &to) {
+  int d = (int)to.h - (int)from.h;
+  if (d > HUE_RANGE / 2) {
+    d -= HUE_RANGE;
+  } else if (d < -HUE_RANGE / 2) {
+    d += HUE_RANGE;
+  }
+  return d;
+}
+
+void hsv_blend(const HSV &from, const HSV &to, uint16_t part, uint16_t whole, HSV &out) {
+  HSV a = from, b = to;
+  hsv_match_hues(a, b);
+  if (!whole || part >= whole) {
+    out = b;
+    return;
+  }
+  long h = a.h + (long)hue_distance(a, b) * part / whole;
+  if (h < 0) {
+    h += HUE_RANGE;
+  } else if (h >= HUE_RANGE) {
+    h -= HUE_RANGE;
+  }
+  out.h = h;
+  out.s = a.s + ((int)b.s - a.s) * (long)part / whole;
+  out.v = a.v + ((int)b.v - a.v) * (long)part / whole;
+}
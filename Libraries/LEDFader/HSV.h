@@ -0,0 +1,45 @@
+/*
+ * HSV.h
+ *
+ * Integer hue/saturation/value colors, for fading through hues instead of
+ * straight across RGB.
+ *
+ * Hue goes round the color wheel in HUE_RANGE steps: red at 0, yellow at
+ * 256, green at 512, cyan at 768, blue at 1024 and magenta at 1280. Within
+ * each of the six sectors one of R, G and B rises or falls linearly while
+ * the other two hold, so going from a color to the next sector boundary
+ * is a straight line in RGB.
+ *
+ * hsv_to_rgb() has no divisions: the sector picks, from a table, which of
+ * four products goes to R, G and B. rgb_to_hsv() divides, once per color.
+ */
+
+#ifndef HSV_H_
+#define HSV_H_
+
+#include "Arduino.h"
+
+#define HUE_SECTOR 256
+#define HUE_RANGE (6 * HUE_SECTOR)
+
+struct HSV {
+  uint16_t h;   // 0 - HUE_RANGE - 1
+  uint8_t s;
+  uint8_t v;
+};
+
+void hsv_to_rgb(const HSV &hsv, uint8_t *rgb);
+void rgb_to_hsv(const uint8_t *rgb, HSV &hsv);
+
+// Greys (and black) have no hue of their own: give them the other color's, so a fade
+// between a grey and a color changes only saturation and value
+void hsv_match_hues(HSV &from, HSV &to);
+
+// How far, and which way, to turn the hue to get from one color to another the short
+// way round (-HUE_RANGE / 2 to HUE_RANGE / 2)
+int hue_distance(const HSV &from, const HSV &to);
+
+// The color part / whole of the way from one color to another, the short way round
+void hsv_blend(const HSV &from, const HSV &to, uint16_t part, uint16_t whole, HSV &out);
+
+#endif /* HSV_H_ */
@@ -11,15 +11,23 @@ LEDFader::LEDFader(uint8_t pwm_pin) {
   pin = pwm_pin;
   color = 0;
   to_color = 0;
-  last_step_time = 0;
-  interval = 0;
-  duration = 0;
-  percent_done = 0;
+  next_step_time = 0;
+  frames = 0;
+  frame_count = 0;
+  frame_time = 0;
+  time_remainder = 0;
+  time_error = 0;
+  frame_step = 0;
+  step_remainder = 0;
+  step_error = 0;
   curve = (curve_function)0;
 }
 
 void LEDFader::set_pin(uint8_t pwm_pin) {
   pin = pwm_pin;
+  if (!pin) {
+    stop_fade();
+  }
 }
 uint8_t LEDFader::get_pin(){
   return pin;
@@ -50,116 +58,176 @@ LEDFader::curve_function LEDFader::get_curve() {
 }
 
 void LEDFader::slower(int by) {
-  float cached_percent = percent_done;
-  duration += by;
-  fade(to_color, duration);
-  percent_done = cached_percent;
+  if (!is_fading()) {
+    return;
+  }
+
+  // Stretch what's left of the fade, keeping the progress made so far
+  unsigned long now = millis();
+  plan(now, remaining(now) + by);
 }
 
 void LEDFader::faster(int by) {
-  float cached_percent = percent_done;
+  if (!is_fading()) {
+    return;
+  }
+
+  unsigned long now = millis();
+  unsigned long left = remaining(now);
 
   // Ends the fade
-  if (duration <= by) {
-    stop_fade();
-    set_value(to_color);
+  if (by < 0 || left <= (unsigned int)by) {
+    finish();
   }
   else {
-    duration -= by;
-    fade(to_color, duration);
+    plan(now, left - by);
   }
-  percent_done = cached_percent;
 }
 
 void LEDFader::fade(uint8_t value, unsigned int time) {
   stop_fade();
-  percent_done = 0;
 
   // No pin defined
   if (!pin) {
     return;
   }
 
-  // Color hasn't changed
+  to_color = value;
+
+  // Color hasn't changed: done already
   if (value == color) {
+    frame_count = 1;
     return;
   }
 
-  if (time <= MIN_INTERVAL) {
-    set_value(value);
+  plan(millis(), time);
+}
+
+void LEDFader::retarget(uint8_t value, unsigned int time) {
+  if (!is_fading()) {
+    if (pin && value != color) {
+      fade(value, time);
+    }
     return;
   }
 
-  duration = time;
-  to_color = (uint8_t)constrain(value, 0, 255);
+  // The same target with at least as long left changes nothing (see FaderBank::retarget())
+  unsigned long now = millis();
+  if (value == to_color && time >= remaining(now)) {
+    return;
+  }
 
-  // Figure out what the interval should be so that we're chaning the color by at least 1 each cycle
-  // (minimum interval is MIN_INTERVAL)
-  float color_diff = abs(color - to_color);
-  interval = round((float)duration / color_diff);
-  if (interval < MIN_INTERVAL) {
-    interval = MIN_INTERVAL;
+  // Plan the rest from the last step, so the next step comes about when it would have and
+  // the fade still ends in time from now
+  unsigned long last = next_step_time - frame_time;
+  if ((long)(now - last) < 0 || (long)(now - next_step_time) >= 0) {
+    last = now;
   }
+  to_color = value;
+  plan(last, now - last + time);
+}
+
+void LEDFader::plan(unsigned long start, unsigned long time) {
+  frames = 0;
+
+  if (time <= MIN_INTERVAL || color == to_color) {
+    finish();
+    return;
+  }
+
+  uint8_t color_diff = (to_color > color) ? to_color - color : color - to_color;
+
+  // Step at most once every MIN_INTERVAL, and never by less than 1
+  unsigned long count = time / MIN_INTERVAL;
+  if (count > color_diff) {
+    count = color_diff;
+  }
+
+  frame_count = count;
+  frame_time = time / count;
+  time_remainder = time % count;
+  frame_step = color_diff / count;
+  step_remainder = color_diff % count;
 
-  last_step_time = millis();
+  // Start the error terms half way, so the extra milliseconds and steps are spread evenly
+  time_error = count / 2;
+  step_error = count / 2;
+
+  next_step_time = start;
+  frames = count;
+  schedule_frame();
 }
 
-bool LEDFader::is_fading() {
-  if (!pin)
-    return false;
-  if (duration > 0)
+bool LEDFader::carry(uint8_t &error, uint8_t remainder) {
+  // error + remainder >= frame_count, without overflowing a byte
+  if (error >= frame_count - remainder) {
+    error -= frame_count - remainder;
     return true;
+  }
+  error += remainder;
   return false;
 }
 
-void LEDFader::stop_fade() {
-  percent_done = 100;
-  duration = 0;
+void LEDFader::schedule_frame() {
+  next_step_time += frame_time;
+  if (carry(time_error, time_remainder)) {
+    next_step_time++;
+  }
 }
 
-uint8_t LEDFader::get_progress() {
-  return round(percent_done);
+unsigned long LEDFader::remaining(unsigned long now) {
+  // The next step, the frames after it, and the extra milliseconds their error term will carry
+  uint8_t after = frames - 1;
+  unsigned long end_time = next_step_time + (unsigned long)after * frame_time +
+      ((unsigned int)time_error + (unsigned int)after * time_remainder) / frame_count;
+  return ((long)(end_time - now) > 0) ? end_time - now : 0;
 }
 
-bool LEDFader::update() {
-
-  // No pin defined
-  if (!pin) {
-    return false;
-  }
-
-  // No fade
-  if (duration == 0) {
-    return false;
-  }
+void LEDFader::finish() {
+  frames = 0;
+  frame_count = 1;
+  set_value(to_color);
+}
 
-  unsigned long now = millis();
-  unsigned int time_diff = now - last_step_time;
+bool LEDFader::is_fading() {
+  return frames > 0;
+}
 
-  // Interval hasn't passed yet
-  if (time_diff < interval) {
-    return true;
-  }
+bool LEDFader::is_finished() {
+  return !frames && frame_count;
+}
 
-  // How far along have we gone since last update
-  float percent = (float)time_diff / (float)duration;
-  percent_done += percent;
+void LEDFader::stop_fade() {
+  frames = 0;
+  frame_count = 0;
+}
 
-  // We've hit 100%, set LED to the final color
-  if (percent >= 1) {
-    stop_fade();
-    set_value(to_color);
-    return false;
+uint8_t LEDFader::get_progress() {
+  if (frames == 0) {
+    return 100;
   }
+  return (unsigned int)(frame_count - frames) * 100 / frame_count;
+}
 
-  // Move color to where it should be
-  int color_diff = to_color - color;
-  int increment = round(color_diff * percent);
-
-  set_value(color + increment);
-
-  // Update time and finish
-  duration -= time_diff;
-  last_step_time = millis();
-  return true;
+void LEDFader::step(unsigned long now) {
+  // Take every step that's due (more than one if loop() ran late)
+  uint8_t value = color;
+  do {
+    uint8_t by = frame_step;
+    if (carry(step_error, step_remainder)) {
+      by++;
+    }
+
+    if (to_color > value) {
+      value += by;
+    } else {
+      value -= by;
+    }
+
+    if (--frames) {
+      schedule_frame();
+    }
+  } while (frames && (long)(now - next_step_time) >= 0);
+
+  set_value(value);
 }
@@ -6,13 +6,21 @@
  */
 
 #include "Arduino.h"
+#include "Curve.h"
+#include "FaderBank.h"
 
 #ifndef LEDFader_H_
 #define LEDFader_H_
 
-// The minimum time (milliseconds) the program will wait between LED adjustments
-// adjust this to modify performance.
-#define MIN_INTERVAL 20
+/*
+ * A single LED on the same integer step schedule as FaderBank (see
+ * FaderBank.h), with only the state one channel needs: 18 bytes of SRAM on
+ * the AVR, where the first float LEDFader took 17. Its level is the 8-bit
+ * value, so a fade steps once per value at most, as the float one did.
+ * For a queue, dithering, 16-bit levels or finished() callbacks, use a
+ * FaderBank, which for more than a few LEDs also shares the time and
+ * updates them all in one pass.
+ */
 
 class LEDFader {
 public:
@@ -20,14 +28,46 @@ public:
   typedef uint8_t (*curve_function)(uint8_t);
 private:
   uint8_t pin;
-  unsigned long last_step_time;
-  unsigned int interval;
   uint8_t color;
   uint8_t to_color;
-  unsigned int duration;
-  float percent_done;
+
+  // The step schedule worked out by plan(). The fade is split into frame_count frames
+  // of frame_time ms that each move the color by frame_step. The remainders of those
+  // divisions are spread across the frames with error accumulators (Bresenham style),
+  // so update() only adds and compares and the fade lands exactly on to_color exactly
+  // when it's due. frame_count stays set until the update() after the fade ends, for
+  // is_finished().
+  unsigned long next_step_time;
+  uint8_t frames;
+  uint8_t frame_count;
+  unsigned int frame_time;
+  uint8_t time_remainder;
+  uint8_t time_error;
+  uint8_t frame_step;
+  uint8_t step_remainder;
+  uint8_t step_error;
+
   curve_function curve;
 
+  // Work out the step schedule from the current color to to_color, starting at start and
+  // ending time milliseconds later
+  void plan(unsigned long start, unsigned long time);
+
+  // Move next_step_time to the end of the next frame
+  void schedule_frame();
+
+  // Take every step of the fade that is due by now
+  void step(unsigned long now);
+
+  // Add a remainder to an error term, returning TRUE when it carries over frame_count
+  bool carry(uint8_t &error, uint8_t remainder);
+
+  // Milliseconds left until the fade in progress is due to end
+  unsigned long remaining(unsigned long now);
+
+  // Jump to to_color, as a fade that has finished
+  void finish();
+
   public:
 
     // Create a new LED Fader for a pin
@@ -52,15 +92,39 @@ private:
     // Fade an LED to a PWM value over a duration of time (milliseconds)
     void fade(uint8_t pwm, unsigned int time);
 
+    // Change the target and remaining time (milliseconds) of the fade in progress,
+    // without starting it over. Starts a new fade if there isn't one.
+    void retarget(uint8_t pwm, unsigned int time);
+
     // Returns TRUE if there is an active fade process
     bool is_fading();
 
+    // Returns TRUE if the fade finished in the last update()
+    bool is_finished();
+
     // Stop the current fade where it's at
     void stop_fade();
 
     // Update the LEDs along the fade
     // Returns TRUE if a fade is still in process
-    bool update();
+    // (Inline, as most calls find the next step isn't due and return straight away)
+    bool update() {
+      // No fade (and the one that finished in the last update() is over)
+      if (frames == 0) {
+        frame_count = 0;
+        return false;
+      }
+
+      unsigned long now = millis();
+
+      // Next step isn't due yet
+      if ((long)(now - next_step_time) < 0) {
+        return true;
+      }
+
+      step(now);
+      return frames > 0;
+    }
 
     // Decrease the current fading speed by a number of milliseconds
     void slower(int by_seconds);
@@ -0,0 +1,95 @@
+/*
+ * PWMOutput.cpp
+ *
+ * High resolution PWM on the ATmega2560's 16-bit timers. See PWMOutput.h
+ */
+
+#include <avr/io.h>
+#include "PWMOutput.h"
+
+#if defined(__AVR_ATmega2560__) || !defined(__AVR__)
+
+// Fast PWM with ICRn as TOP (mode 14), no prescaler, unless the timer is set up already.
+// The bits are in the same place on all four timers. Leaves the COM bits (which pins are
+// connected) as they are.
+template <class REG8, class REG16>
+static void setup_timer(REG8 &tccra, REG8 &tccrb, REG16 &icr) {
+  if (icr == TIMER_PWM_TOP && (tccrb & _BV(WGM13))) {
+    return;
+  }
+  tccrb = 0;
+  icr = TIMER_PWM_TOP;
+  tccra = (tccra & ~(_BV(WGM10) | _BV(WGM11))) | _BV(WGM11);
+  tccrb = _BV(WGM13) | _BV(WGM12) | _BV(CS10);
+}
+
+// Level 0 disconnects the pin from the timer and holds it low (even OCRnx = 0 would give a
+// pulse of one cycle). Level n connects it with OCRnx = n - 1, on for n cycles out of TOP + 1.
+template <class REG8, class REG16>
+static void write_channel(uint8_t pin, REG8 &tccra, REG16 &ocr, uint8_t com, uint16_t level) {
+  if (!level) {
+    tccra &= ~_BV(com);
+    digitalWrite(pin, LOW);
+    return;
+  }
+  ocr = level - 1;
+  if (!(tccra & _BV(com))) {
+    pinMode(pin, OUTPUT);
+    tccra |= _BV(com);
+  }
+}
+
+#define TIMER_PIN(p, n, x) \
+  case p: \
+    setup_timer(TCCR##n##A, TCCR##n##B, ICR##n); \
+    write_channel(p, TCCR##n##A, OCR##n##x, COM##n##x##1, level); \
+    return;
+
+bool timer_pwm_pin(uint8_t pin) {
+  switch (pin) {
+    case 2: case 3: case 5:
+    case 6: case 7: case 8:
+    case 11: case 12: case 13:
+    case 44: case 45: case 46:
+      return true;
+  }
+  return false;
+}
+
+void timer_pwm_write(uint8_t pin, uint16_t level) {
+  switch (pin) {
+    TIMER_PIN(2, 3, B)
+    TIMER_PIN(3, 3, C)
+    TIMER_PIN(5, 3, A)
+    TIMER_PIN(6, 4, A)
+    TIMER_PIN(7, 4, B)
+    TIMER_PIN(8, 4, C)
+    TIMER_PIN(11, 1, A)
+    TIMER_PIN(12, 1, B)
+    TIMER_PIN(13, 1, C)
+    TIMER_PIN(44, 5, C)
+    TIMER_PIN(45, 5, B)
+    TIMER_PIN(46, 5, A)
+  }
+  analogWrite(pin, level);
+}
+
+#else
+
+// Not a Mega: 8 bits everywhere
+bool timer_pwm_pin(uint8_t) {
+  return false;
+}
+
+void timer_pwm_write(uint8_t pin, uint16_t level) {
+  analogWrite(pin, level);
+}
+
+#endif
+
+uint16_t timer_pwm_level(uint8_t pin, uint16_t duty) {
+  if (timer_pwm_pin(pin)) {
+    return ((uint32_t)duty + (1 << (15 - TIMER_PWM_BITS))) >> (16 - TIMER_PWM_BITS);
+  }
+  return duty_to_8bit(duty);
+}
@@ -0,0 +1,63 @@
+/*
+ * PWMOutput.h
+ *
+ * How a FaderBank writes duty cycles to its pins. The bank works out a
+ * 16-bit duty cycle (0 - 65535) for a channel, asks its output for the
+ * level the pin can actually show (level()), and only calls write() when
+ * that level changes.
+ *
+ *   AnalogOutput  analogWrite(), 8 bits on every pin (the default)
+ *
+ *   TimerOutput   On an ATmega2560, pins on the 16-bit timers 1, 3, 4 and 5
+ *                 get TIMER_PWM_BITS of resolution: the timer is switched to
+ *                 fast PWM with ICRn as TOP and no prescaler, which at 16 MHz
+ *                 and 12 bits is 3.9 kHz (analogWrite() runs them at 490 Hz).
+ *                 Other pins use analogWrite(). Once a timer is switched,
+ *                 analogWrite() on its pins no longer gives the right duty
+ *                 cycle, so use timer_pwm_write() for all of them.
+ *
+ *   Timer pins: 2, 3, 5 (timer 3), 6, 7, 8 (timer 4), 11, 12, 13 (timer 1,
+ *   13 through OC1C instead of timer 0's OC0A) and 44, 45, 46 (timer 5).
+ */
+
+#ifndef PWMOutput_H_
+#define PWMOutput_H_
+
+#include "Arduino.h"
+
+// Resolution of the 16-bit timer outputs
+#ifndef TIMER_PWM_BITS
+#define TIMER_PWM_BITS 12
+#endif
+#define TIMER_PWM_TOP ((1 << TIMER_PWM_BITS) - 1)
+
+// Returns TRUE if a pin gets TIMER_PWM_BITS from timer_pwm_write()
+bool timer_pwm_pin(uint8_t pin);
+
+// The level a 16-bit duty cycle comes out at on a pin: 0 - (1 << TIMER_PWM_BITS) on a timer pin
+// (that many 1 / (TIMER_PWM_TOP + 1)ths of the time on), 0 - 255 for analogWrite() on the others
+uint16_t timer_pwm_level(uint8_t pin, uint16_t duty);
+
+// Write a level from timer_pwm_level() to a pin
+void timer_pwm_write(uint8_t pin, uint16_t level);
+
+// 16-bit duty cycle to analogWrite()'s 0 - 255, rounded (v * 257 comes back as v)
+inline uint8_t duty_to_8bit(uint16_t duty) {
+  return (duty - (duty >> 8) + 128) >> 8;
+}
+
+// level() turns a 16-bit duty cycle into what write() takes for a pin, and bits() says how
+// many bits of resolution that has
+struct AnalogOutput {
+  static uint8_t bits(uint8_t) { return 8; }
+  static uint16_t level(uint8_t, uint16_t duty) { return duty_to_8bit(duty); }
+  static void write(uint8_t pin, uint16_t level) { analogWrite(pin, level); }
+};
+
+struct TimerOutput {
+  static uint8_t bits(uint8_t pin) { return timer_pwm_pin(pin) ? TIMER_PWM_BITS : 8; }
+  static uint16_t level(uint8_t pin, uint16_t duty) { return timer_pwm_level(pin, duty); }
+  static void write(uint8_t pin, uint16_t level) { timer_pwm_write(pin, level); }
+};
+
+#endif /* PWMOutput_H_ */
@@ -0,0 +1,173 @@
+/*
+ * Log.cpp
+ *
+ * Diagnostics that never block loop(). See Log.h
+ */
+
+#include "Log.h"
+
+#define RING_MASK (LOG_BUFFER_SIZE - 1)
+
+Logger logger;
+
+Logger::Logger() {
+  port = 0;
+  head = 0;
+  count = 0;
+  message_start = 0;
+  overflow = false;
+  dropped = 0;
+  unreported = 0;
+}
+
+void Logger::begin(HardwareSerial &serial) {
+  port = &serial;
+}
+
+/**
+ * Add a byte to the message being formatted. Once one byte doesn't fit,
+ * the rest of the message is ignored and end_message() throws it away.
+ */
+void Logger::put(char c) {
+  if (overflow) return;
+  if (count == LOG_BUFFER_SIZE) {
+    overflow = true;
+    return;
+  }
+  ring[(head + count) & RING_MASK] = c;
+  count++;
+}
+
+void Logger::put_string(const char *str, bool flash) {
+  if (!str) return;
+  for (;;) {
+    char c = flash ? pgm_read_byte(str) : *str;
+    if (!c) return;
+    put(c);
+    str++;
+  }
+}
+
+void Logger::put_number(unsigned long n, uint8_t base, bool negative) {
+  // Enough for any unsigned long in base 10 or 16 (3 digits a byte is generous for both)
+  char digits[3 * sizeof(unsigned long)];
+  uint8_t i = 0;
+
+  do {
+    uint8_t d = n % base;
+    digits[i++] = d < 10 ? '0' + d : 'a' + d - 10;
+    n /= base;
+  } while (n);
+
+  if (negative) put('-');
+  while (i) put(digits[--i]);
+}
+
+void Logger::begin_message() {
+  message_start = count;
+  overflow = false;
+}
+
+void Logger::end_message() {
+  put('\r');
+  put('\n');
+
+  // Didn't fit: take back the part that did
+  if (overflow) {
+    count = message_start;
+    dropped++;
+    unreported++;
+  }
+}
+
+void Logger::printf(const __FlashStringHelper *format, ...) {
+  va_list args;
+  va_start(args, format);
+  vprintf(format, args);
+  va_end(args);
+}
+
+void Logger::vprintf(const __FlashStringHelper *format, va_list args) {
+  PGM_P p = reinterpret_cast<PGM_P>(format);
+
+  begin_message();
+  for (;;) {
+    char c = pgm_read_byte(p++);
+    if (!c) break;
+
+    if (c != '%') {
+      put(c);
+      continue;
+    }
+
+    bool is_long = false;
+    c = pgm_read_byte(p++);
+    if (c == 'l') {
+      is_long = true;
+      c = pgm_read_byte(p++);
+    }
+
+    switch (c) {
+    case 'd': {
+      long v = is_long ? va_arg(args, long) : va_arg(args, int);
+      put_number(v < 0 ? -(unsigned long)v : v, 10, v < 0);
+      break;
+    }
+    case 'u':
+      put_number(is_long ? va_arg(args, unsigned long) : va_arg(args, unsigned int), 10, false);
+      break;
+    case 'x':
+      put_number(is_long ? va_arg(args, unsigned long) : va_arg(args, unsigned int), 16, false);
+      break;
+    case 'c':
+      put((char)va_arg(args, int));
+      break;
+    case 's':
+      put_string(va_arg(args, const char *), false);
+      break;
+    case 'S':
+      put_string(va_arg(args, const char *), true);
+      break;
+    case '\0':
+      p--;
+      break;
+    default:
+      put(c);
+      break;
+    }
+  }
+  end_message();
+}
+
+void Logger::drain() {
+  if (!port) return;
+
+  // Let the reader know what they missed, once there's room to say so
+  if (unreported) {
+    unsigned long missed = unreported;
+    unreported = 0;
+    printf(F("(%lu log messages dropped)"), missed);
+
+    // The notice didn't fit either. It isn't a message of its own, so try again later
+    if (overflow) {
+      dropped--;
+      unreported = missed;
+    }
+  }
+
+  int room = port->availableForWrite();
+  while (count && room > 0) {
+    port->write((uint8_t)ring[head]);
+    head = (head + 1) & RING_MASK;
+    count--;
+    room--;
+  }
+}
+
+uint16_t Logger::pending() {
+  return count;
+}
+
+unsigned long Logger::get_dropped() {
+  return dropped;
+}
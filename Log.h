@@ -0,0 +1,113 @@
+/*
+ * Log.h
+ *
+ * Diagnostics that never block loop().
+ *
+ * Messages are formatted straight into a small ring buffer in RAM, and
+ * drain() moves as much of it to the serial port as the port's TX buffer
+ * can take without waiting. If a message doesn't fit in the ring, the whole
+ * message is dropped and counted, rather than stalling the LEDs.
+ *
+ * Format strings stay in flash (the macros wrap them in F()), and anything
+ * below LOG_LEVEL is compiled out entirely, arguments and all.
+ *
+ *   LOG_INFO("Close range: %d", distance);
+ *
+ * Format specifiers: %d %u %ld %lu %x %c %s, %S for a flash string, and %%.
+ * Only log from loop(), not from interrupts.
+ */
+
+#ifndef Log_H_
+#define Log_H_
+
+#include <stdarg.h>
+#include "Arduino.h"
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+// The most detailed level that's built in
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// Bytes of RAM the ring buffer takes (a power of 2, up to 256)
+#ifndef LOG_BUFFER_SIZE
+#define LOG_BUFFER_SIZE 128
+#endif
+
+#if LOG_BUFFER_SIZE > 256 || (LOG_BUFFER_SIZE & (LOG_BUFFER_SIZE - 1))
+#error LOG_BUFFER_SIZE must be a power of 2, up to 256
+#endif
+
+class Logger {
+  HardwareSerial *port;
+
+  char ring[LOG_BUFFER_SIZE];
+  uint8_t head;      // Next byte to drain
+  uint16_t count;    // Bytes waiting to drain
+
+  // The message being formatted: where it starts, and whether it ran out of room
+  uint16_t message_start;
+  bool overflow;
+
+  // Messages dropped, in total and since drain() last reported them
+  unsigned long dropped;
+  unsigned long unreported;
+
+  void put(char c);
+  void put_string(const char *str, bool flash);
+  void put_number(unsigned long n, uint8_t base, bool negative);
+  void begin_message();
+  void end_message();
+
+public:
+  Logger();
+
+  // Send the log to this port (until then, messages just wait in the ring)
+  void begin(HardwareSerial &serial);
+
+  // Format a message (see the top of this file) and queue it with a line ending
+  void printf(const __FlashStringHelper *format, ...);
+  void vprintf(const __FlashStringHelper *format, va_list args);
+
+  // Move what the port can take right now from the ring to the port. Never blocks.
+  void drain();
+
+  // Bytes waiting to drain
+  uint16_t pending();
+
+  // Number of messages dropped because the ring was full
+  unsigned long get_dropped();
+};
+
+extern Logger logger;
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(format, ...) logger.printf(F(format), ##__VA_ARGS__)
+#else
+#define LOG_ERROR(format, ...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(format, ...) logger.printf(F(format), ##__VA_ARGS__)
+#else
+#define LOG_WARN(format, ...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(format, ...) logger.printf(F(format), ##__VA_ARGS__)
+#else
+#define LOG_INFO(format, ...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(format, ...) logger.printf(F(format), ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(format, ...) do {} while (0)
+#endif
+
+#endif /* Log_H_ */
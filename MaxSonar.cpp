@@ -0,0 +1,101 @@
+/*
+ * MaxSonar.cpp
+ *
+ * Reads the range frames from a MaxSonar HRLV-EZ. See MaxSonar.h
+ */
+
+#include "MaxSonar.h"
+#include "Trace.h"
+
+MaxSonar::MaxSonar(Stream &stream) : in(stream) {
+  state = WAIT_START;
+  digits = 0;
+  value = 0;
+  skipping = false;
+  distance = 0;
+  reading_time = 0;
+  frames = 0;
+  errors = 0;
+}
+
+bool MaxSonar::poll() {
+  bool fresh = false;
+  while (in.available() > 0) {
+    if (parse(TRACE_INPUT(TRACE_SONAR, in.read()))) {
+      fresh = true;
+    }
+  }
+  return fresh;
+}
+
+// Throw away the frame in progress and skip to the next 'R'
+void MaxSonar::error() {
+  if (state != WAIT_START || !skipping) {
+    errors++;
+  }
+  state = WAIT_START;
+  skipping = true;
+}
+
+/**
+ * Feed one byte to the parser. Returns true when it completes a frame.
+ */
+bool MaxSonar::parse(uint8_t c) {
+
+  // An 'R' always starts a new frame, even in the middle of a broken one
+  if (c == 'R') {
+    if (state != WAIT_START) {
+      errors++;
+    }
+    state = DIGITS;
+    digits = 0;
+    value = 0;
+    skipping = false;
+    return false;
+  }
+
+  switch (state) {
+  case WAIT_START:
+    error();
+    return false;
+
+  case DIGITS:
+    if (c < '0' || c > '9') {
+      error();
+      return false;
+    }
+    value = value * 10 + (c - '0');
+    if (++digits == 4) {
+      state = WAIT_END;
+    }
+    return false;
+
+  case WAIT_END:
+    if (c != '\r') {
+      error();
+      return false;
+    }
+    state = WAIT_START;
+    distance = value;
+    reading_time = millis();
+    frames++;
+    return true;
+  }
+  return false;
+}
+
+unsigned int MaxSonar::get_distance() {
+  return distance;
+}
+
+unsigned long MaxSonar::get_reading_time() {
+  return reading_time;
+}
+
+unsigned long MaxSonar::get_frames() {
+  return frames;
+}
+
+unsigned long MaxSonar::get_errors() {
+  return errors;
+}
@@ -0,0 +1,59 @@
+/*
+ * MaxSonar.h
+ *
+ * Reads the range frames a MaxSonar HRLV-EZ sends on its serial output:
+ * 'R', four ASCII digits of millimeters, and a carriage return ("R0850\r").
+ *
+ * poll() consumes every byte that has arrived, one at a time, so a frame
+ * split across calls is fine. Each frame is checked as it comes in; a bad
+ * byte throws the frame away and the parser waits for the next 'R', so a
+ * dropped or corrupted byte costs one reading instead of garbage.
+ */
+
+#ifndef MaxSonar_H_
+#define MaxSonar_H_
+
+#include "Arduino.h"
+
+class MaxSonar {
+  Stream &in;
+
+  // Where we are in the frame
+  enum State {
+    WAIT_START, // Waiting for 'R'
+    DIGITS,     // Reading the four digits
+    WAIT_END    // Waiting for '\r'
+  };
+  State state;
+  uint8_t digits;
+  unsigned int value;
+
+  // True while skipping bytes that aren't part of a frame
+  bool skipping;
+
+  unsigned int distance;
+  unsigned long reading_time;
+  unsigned long frames;
+  unsigned long errors;
+
+  bool parse(uint8_t c);
+  void error();
+
+public:
+  MaxSonar(Stream &stream);
+
+  // Read everything available. Returns true if it completed at least one new reading.
+  bool poll();
+
+  // The latest reading, in millimeters (0 until the first one)
+  unsigned int get_distance();
+
+  // millis() when the latest reading came in
+  unsigned long get_reading_time();
+
+  // Number of good frames, and of frames or stray bytes thrown away
+  unsigned long get_frames();
+  unsigned long get_errors();
+};
+
+#endif /* MaxSonar_H_ */
@@ -0,0 +1,93 @@
+/*
+ * Profile.cpp
+ *
+ * Where loop()'s time goes. See Profile.h
+ */
+
+#include "Log.h"
+#include "Profile.h"
+
+#if PROFILE
+
+Profiler profiler;
+
+const char stage_loop[] PROGMEM = "loop";
+const char stage_fades[] PROGMEM = "fades";
+const char stage_program[] PROGMEM = "program";
+const char stage_sonar[] PROGMEM = "sonar";
+const char stage_console[] PROGMEM = "console";
+const char stage_eeprom[] PROGMEM = "eeprom";
+const char stage_log[] PROGMEM = "log";
+
+const char * const stage_names[PROFILE_STAGES] PROGMEM = {
+  stage_loop,
+  stage_fades,
+  stage_program,
+  stage_sonar,
+  stage_console,
+  stage_eeprom,
+  stage_log
+};
+
+Profiler::Profiler() {
+  held = false;
+  reset();
+}
+
+void Profiler::add(uint8_t stage, unsigned long us) {
+  if (held) {
+    return;
+  }
+  Stage &s = stages[stage];
+
+  if (!s.count || us < s.min) {
+    s.min = us;
+  }
+  if (us > s.max) {
+    s.max = us;
+  }
+  s.count++;
+
+  // Before the total can overflow, halve it along with the times it's over, keeping the average
+  if (s.total + us < s.total) {
+    s.total >>= 1;
+    s.averaged >>= 1;
+  }
+  s.total += us;
+  s.averaged++;
+
+  uint8_t bucket = 0;
+  for (unsigned long limit = 8; us >= limit && bucket < PROFILE_BUCKETS - 1; limit <<= 1) {
+    bucket++;
+  }
+  if (s.histogram[bucket] < 0xFFFF) {
+    s.histogram[bucket]++;
+  }
+}
+
+void Profiler::reset() {
+  memset(stages, 0, sizeof(stages));
+}
+
+void Profiler::report(uint8_t line) {
+  if (!line) {
+    logger.printf(F("Profile (us): runs, min avg max / <8 <16 <32 <64 <128 <256 <512 <1k <2k <4k <8k more"));
+    return;
+  }
+
+  line--;
+  Stage &s = stages[line / 2];
+  PGM_P name = (PGM_P)pgm_read_ptr(&stage_names[line / 2]);
+
+  if (!(line & 1)) {
+    logger.printf(F("%S %lu, %lu %lu %lu"), name, s.count,
+        s.min, s.averaged ? s.total / s.averaged : 0, s.max);
+    return;
+  }
+
+  const uint16_t *h = s.histogram;
+  logger.printf(F("%S / %u %u %u %u %u %u %u %u %u %u %u %u"), name,
+      h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7], h[8], h[9], h[10], h[11]);
+}
+
+#endif
@@ -0,0 +1,92 @@
+/*
+ * Profile.h
+ *
+ * Where loop()'s time goes, measured on the board.
+ *
+ * Each stage of loop() is wrapped in PROFILE_BEGIN/PROFILE_END, which read
+ * micros() either side of it and add the time to that stage's count, total,
+ * min and max, and to a histogram of PROFILE_BUCKETS buckets that double in
+ * width: under 8us, under 16us, ... under 8192us, and 8192us or more. It's
+ * all in a fixed table in RAM (44 bytes a stage); nothing is printed
+ * until asked for.
+ *
+ *   PROFILE_BEGIN(PROFILE_CONSOLE);
+ *   console.poll();
+ *   PROFILE_END(PROFILE_CONSOLE);
+ *
+ * The console's "profile" command prints the table and "profile reset"
+ * clears it (see Console.h); nothing is counted while the report is being
+ * printed, so its lines agree. Stages can nest: PROFILE_SONAR is part of
+ * PROFILE_PROGRAM, and everything is part of PROFILE_LOOP. micros() counts
+ * in steps of 4us on a 16 MHz board, so the shortest stages read 0 or 4.
+ *
+ * Built with PROFILE 0 (the default), the macros are empty and none of this
+ * is compiled in.
+ */
+
+#ifndef Profile_H_
+#define Profile_H_
+
+#include "Arduino.h"
+
+#ifndef PROFILE
+#define PROFILE 0
+#endif
+
+// The stages of loop()
+#define PROFILE_LOOP 0     // All of loop()
+#define PROFILE_FADES 1    // shelves.update() and sequencer.update()
+#define PROFILE_PROGRAM 2  // run_program()
+#define PROFILE_SONAR 3    // get_distance(), reading and filtering the sonar
+#define PROFILE_CONSOLE 4  // console.poll()
+#define PROFILE_EEPROM 5   // Saving colors and settings
+#define PROFILE_LOG 6      // logger.drain()
+#define PROFILE_STAGES 7
+
+// Histogram buckets: bucket i counts times under 8 << i microseconds, the last one the rest
+#define PROFILE_BUCKETS 12
+
+#if PROFILE
+
+class Profiler {
+  struct Stage {
+    unsigned long count;
+    unsigned long total;     // Microseconds, over the last `averaged` times
+    unsigned long averaged;
+    unsigned long min;
+    unsigned long max;
+    uint16_t histogram[PROFILE_BUCKETS];
+  };
+  Stage stages[PROFILE_STAGES];
+  bool held;
+
+public:
+  Profiler();
+
+  // Count a time (microseconds) for a stage
+  void add(uint8_t stage, unsigned long us);
+
+  // Forget every time counted
+  void reset();
+
+  // Stop counting (and start again), so a report printed over several loops adds up
+  void hold(bool on) { held = on; }
+
+  // The report is a heading and two lines per stage. Log line n of it.
+  uint8_t report_lines() { return 1 + 2 * PROFILE_STAGES; }
+  void report(uint8_t line);
+};
+
+extern Profiler profiler;
+
+#define PROFILE_BEGIN(stage) unsigned long profile_start_##stage = micros()
+#define PROFILE_END(stage) profiler.add(stage, micros() - profile_start_##stage)
+
+#else
+
+#define PROFILE_BEGIN(stage) do {} while (0)
+#define PROFILE_END(stage) do {} while (0)
+
+#endif
+
+#endif /* Profile_H_ */
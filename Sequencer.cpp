@@ -0,0 +1,189 @@
+/*
+ * Sequencer.cpp
+ *
+ * Plays keyframe light shows from program memory. See Sequencer.h
+ */
+
+#include "BoozeBookshelf.h"
+#include "Sequencer.h"
+
+// How far along (out of 256) each quarter of an eased fade ends
+#define EASE_SEGMENTS 4
+const uint16_t ease_points[][EASE_SEGMENTS] PROGMEM = {
+  {  64, 128, 192, 256 }, // EASE_LINEAR (not used, linear fades are one segment)
+  {  16,  64, 144, 256 }, // EASE_IN     (t^2)
+  { 112, 192, 240, 256 }, // EASE_OUT    (1 - (1 - t)^2)
+  {  40, 128, 216, 256 }  // EASE_IN_OUT (3t^2 - 2t^3)
+};
+
+// Most keyframes to go through looking for the next step, before deciding there isn't one
+#define MAX_SKIP 64
+
+Sequencer::Sequencer() {
+  show = 0;
+  playing = false;
+  index = 0;
+  next_index = 0;
+  segment = 0;
+  segments = 1;
+  loop_start = 0;
+  loops_left = 0;
+  next_time = 0;
+  tempo = TEMPO_NORMAL;
+}
+
+void Sequencer::play(const Keyframe *keyframes, unsigned int play_tempo) {
+  show = keyframes;
+  tempo = play_tempo;
+  index = 0;
+  next_index = 0;
+  segment = 0;
+  segments = 1;
+  loop_start = 0;
+  loops_left = 0;
+  next_time = millis();
+  playing = true;
+}
+
+void Sequencer::shift(int by) {
+  next_time += by;
+}
+
+unsigned int Sequencer::segment_time(const Keyframe &key, uint8_t seg, uint8_t count) {
+  unsigned long time = (unsigned long)key.duration * tempo / TEMPO_NORMAL;
+  if (time > 0xFFFF) {
+    time = 0xFFFF;
+  }
+
+  // The last segment gets what's left over
+  unsigned int each = time / count;
+  if (seg == count - 1) {
+    return time - each * (count - 1);
+  }
+  return each;
+}
+
+void Sequencer::play_segment() {
+  Keyframe key;
+  uint8_t i;
+
+  // How many segments the step has: eased keyframes are faded a quarter at a time
+  if (segment == 0) {
+    segments = 1;
+    i = index;
+    do {
+      read(i++, key);
+      if ((key.easing & EASE_MASK) != EASE_LINEAR) {
+        segments = EASE_SEGMENTS;
+      }
+    } while (key.op & KEY_FLAG_WITH);
+  }
+
+  i = index;
+  do {
+    read(i++, key);
+
+    // Linear fades are started once, for the whole step
+    uint8_t easing = key.easing & EASE_MASK;
+    bool linear = easing == EASE_LINEAR;
+    if (linear && segment > 0) {
+      continue;
+    }
+
+    unsigned int time = linear ? segment_time(key, 0, 1) : segment_time(key, segment, segments);
+
+    // Where this segment ends, out of 256, and where it starts
+    uint16_t to = 256, from = 0;
+    if (!linear) {
+      to = pgm_read_word(&ease_points[easing][segment]);
+      from = segment ? pgm_read_word(&ease_points[easing][segment - 1]) : 0;
+    }
+
+    for (uint8_t shelf = 0; shelf < SHELVES; shelf++) {
+      if (!(key.shelves & SHELF(shelf))) {
+        continue;
+      }
+
+      // Move the part of the way that's left that this segment covers
+      uint8_t values[RGB];
+      // (measured round the color wheel, for EASE_HUE)
+      if (key.easing & EASE_HUE) {
+        if (to == 256) {
+          memcpy(values, key.color, RGB);
+        } else {
+          uint8_t current[RGB];
+          HSV here, there, at;
+          for (uint8_t c = 0; c < RGB; c++) {
+            current[c] = shelves.get_value(shelf * RGB + c);
+          }
+          rgb_to_hsv(current, here);
+          rgb_to_hsv(key.color, there);
+          hsv_blend(here, there, to - from, 256 - from, at);
+          hsv_to_rgb(at, values);
+        }
+        shelves.fade_group_hue(shelf, values, time);
+        continue;
+      }
+      for (uint8_t c = 0; c < RGB; c++) {
+        int current = shelves.get_value(shelf * RGB + c);
+        values[c] = current + ((long)key.color[c] - current) * (to - from) / (256 - from);
+      }
+      shelves.fade_group(shelf, values, time);
+    }
+  } while (key.op & KEY_FLAG_WITH);
+  next_index = i;
+
+  // The step takes as long as its last keyframe
+  next_time += segment_time(key, segment, segments);
+}
+
+bool Sequencer::update(unsigned long now) {
+  if (!playing || (long)(now - next_time) < 0) {
+    return playing;
+  }
+
+  // Next quarter of an eased step
+  if (segment + 1 < segments) {
+    segment++;
+    play_segment();
+    return true;
+  }
+
+  // Next step
+  index = next_index;
+  segment = 0;
+  for (uint8_t skipped = 0; skipped < MAX_SKIP; skipped++) {
+    Keyframe key;
+    read(index, key);
+
+    switch (key.op & KEY_OP_MASK) {
+    case KEY_OP_FADE:
+      play_segment();
+      return true;
+
+    case KEY_OP_LOOP:
+      index++;
+      loop_start = index;
+      loops_left = key.duration;
+      break;
+
+    case KEY_OP_REPEAT:
+      if (loops_left == 0 || --loops_left) {
+        index = loop_start;
+      }
+      else {
+        index++;
+      }
+      break;
+
+    case KEY_OP_END:
+    default:
+      playing = false;
+      return false;
+    }
+  }
+
+  // A loop with nothing in it
+  playing = false;
+  return false;
+}
@@ -0,0 +1,132 @@
+/*
+ * Sequencer.h
+ *
+ * Plays light shows written as tables of keyframes in program memory.
+ *
+ * Each keyframe fades a set of shelves to an RGB color over a duration,
+ * with an easing. Keyframes marked WITH start together with the keyframe
+ * after them, so a step can give each shelf its own color; the step takes
+ * as long as its last keyframe. LOOP/REPEAT mark a part of the show to
+ * play over (one level, they don't nest), and END stops it (a show
+ * without a loop should end with END).
+ *
+ *   const Keyframe show[] PROGMEM = {
+ *     KEY_LOOP(0),                                      // forever
+ *       KEY_WITH(SHELF(0) | SHELF(2), 255, 0, 0, 1000, EASE_IN_OUT),
+ *       KEY(SHELF(1) | SHELF(3), 0, 0, 255, 1000, EASE_IN_OUT),
+ *       KEY(ALL_SHELVES, 0, 255, 0, 500, EASE_LINEAR | EASE_HUE),
+ *       KEY_HOLD(250),
+ *     KEY_REPEAT()
+ *   };
+ *
+ *   sequencer.play(show);   // then sequencer.update(now) every loop()
+ *
+ * The sequencer only keeps a cursor into the table. It wakes up when the
+ * current step (or a quarter of it, for eased keyframes) is due and starts
+ * the fades for that step's keyframes; the FaderBank does the rest.
+ */
+
+#ifndef Sequencer_H_
+#define Sequencer_H_
+
+#include "Arduino.h"
+
+// Keyframe operations
+#define KEY_OP_FADE 0
+#define KEY_OP_LOOP 1
+#define KEY_OP_REPEAT 2
+#define KEY_OP_END 3
+#define KEY_OP_MASK 0x0F
+
+// Start the next keyframe at the same time as this one
+#define KEY_FLAG_WITH 0x10
+
+// Easing of a fade
+#define EASE_LINEAR 0
+#define EASE_IN 1
+#define EASE_OUT 2
+#define EASE_IN_OUT 3
+#define EASE_MASK 0x0F
+
+// Added to an easing: fade round the color wheel instead of straight across RGB
+#define EASE_HUE 0x80
+
+// Shelf masks
+#define SHELF(n) (1 << (n))
+#define ALL_SHELVES 0xFF
+
+// Durations are written for a tempo of TEMPO_NORMAL; at tempo t they take duration * t / TEMPO_NORMAL
+#define TEMPO_NORMAL 1000
+
+struct Keyframe {
+  uint8_t op;         // KEY_OP_* and KEY_FLAG_*
+  uint8_t shelves;    // Shelves to fade (bit 0 = top shelf)
+  uint8_t color[3];   // R, G, B
+  uint8_t easing;     // EASE_*, and EASE_HUE
+  uint16_t duration;  // Milliseconds (the loop count, for KEY_LOOP)
+};
+
+// Fade shelves to a color over a duration (milliseconds) with an easing
+#define KEY(shelves, r, g, b, ms, easing) { KEY_OP_FADE, (shelves), { (r), (g), (b) }, (easing), (ms) }
+
+// Like KEY, but the next keyframe starts at the same time
+#define KEY_WITH(shelves, r, g, b, ms, easing) { KEY_OP_FADE | KEY_FLAG_WITH, (shelves), { (r), (g), (b) }, (easing), (ms) }
+
+// Just wait
+#define KEY_HOLD(ms) { KEY_OP_FADE, 0, { 0, 0, 0 }, EASE_LINEAR, (ms) }
+
+// Play what's between KEY_LOOP and KEY_REPEAT this many times (0 = forever)
+#define KEY_LOOP(times) { KEY_OP_LOOP, 0, { 0, 0, 0 }, 0, (times) }
+#define KEY_REPEAT() { KEY_OP_REPEAT, 0, { 0, 0, 0 }, 0, 0 }
+
+// Stop playing
+#define KEY_END() { KEY_OP_END, 0, { 0, 0, 0 }, 0, 0 }
+
+class Sequencer {
+  const Keyframe *show;
+  bool playing;
+
+  // The step playing: its first keyframe, the keyframe after it, and which quarter of it
+  uint8_t index;
+  uint8_t next_index;
+  uint8_t segment;
+  uint8_t segments;
+
+  uint8_t loop_start;
+  uint16_t loops_left;
+
+  unsigned long next_time;
+  unsigned int tempo;
+
+  void read(uint8_t i, Keyframe &key) { memcpy_P(&key, &show[i], sizeof(Keyframe)); }
+
+  // Start the current segment of the step at index
+  void play_segment();
+
+  // Milliseconds segment seg (of count) of a keyframe takes at the current tempo
+  unsigned int segment_time(const Keyframe &key, uint8_t seg, uint8_t count);
+
+public:
+  Sequencer();
+
+  // Start playing a show (a Keyframe table in program memory) from the top
+  void play(const Keyframe *keyframes, unsigned int play_tempo = TEMPO_NORMAL);
+
+  // Stop playing, leaving the fades in progress to finish
+  void stop() { playing = false; }
+
+  bool is_playing() { return playing; }
+
+  // Change the tempo for the steps still to come
+  void set_tempo(unsigned int t) { tempo = t; }
+  unsigned int get_tempo() { return tempo; }
+
+  // Move the end of the current step by a number of milliseconds (negative for sooner)
+  void shift(int by);
+
+  // Start whatever steps are due. Call it every loop().
+  // Returns TRUE while the show is playing
+  bool update(unsigned long now);
+};
+
+#endif /* Sequencer_H_ */
@@ -0,0 +1,112 @@
+/*
+ * Settings.cpp
+ *
+ * Tunable settings, kept in EEPROM. See Settings.h
+ */
+
+#include <stddef.h>
+#include "BoozeBookshelf.h"
+
+Settings settings;
+
+EEPROMStore<Settings> settings_store(SETTINGS_EEPROM_ADDRESS, SETTINGS_EEPROM_SLOTS, SETTINGS_SAVE_DELAY);
+
+// The name, place and range of each setting, all in program memory
+struct SettingInfo {
+  PGM_P name;
+  uint8_t offset;
+  uint16_t min;
+  uint16_t max;
+};
+
+const char name_close_range[] PROGMEM = "close_range";
+const char name_med_range[] PROGMEM = "med_range";
+const char name_hysteresis[] PROGMEM = "hysteresis";
+const char name_out_of_range_delay[] PROGMEM = "out_of_range_delay";
+const char name_fade_speed[] PROGMEM = "fade_speed";
+const char name_min_interval[] PROGMEM = "min_interval";
+const char name_program2_speed[] PROGMEM = "program2_speed";
+const char name_program[] PROGMEM = "program";
+
+const SettingInfo setting_info[] PROGMEM = {
+  { name_close_range,        offsetof(Settings, close_range),        MIN_RANGE, 5000 },
+  { name_med_range,          offsetof(Settings, med_range),          MIN_RANGE, 5000 },
+  { name_hysteresis,         offsetof(Settings, hysteresis),         0, 1000 },
+  { name_out_of_range_delay, offsetof(Settings, out_of_range_delay), 0, 30000 },
+  { name_fade_speed,         offsetof(Settings, fade_speed),         0, 30000 },
+  { name_min_interval,       offsetof(Settings, min_interval),       1, 1000 },
+  { name_program2_speed,     offsetof(Settings, program2_speed),     500, 30000 },
+  { name_program,            offsetof(Settings, program),            0, 3 }
+};
+#define SETTINGS (sizeof(setting_info) / sizeof(setting_info[0]))
+
+void reset_settings() {
+  settings.version = SETTINGS_VERSION;
+  settings.close_range = CLOSE_RANGE;
+  settings.med_range = MED_RANGE;
+  settings.hysteresis = RANGE_HYSTERESIS;
+  settings.out_of_range_delay = OUT_OF_RANGE_DELAY;
+  settings.fade_speed = FADE_SPEED;
+  settings.min_interval = MIN_INTERVAL;
+  settings.program2_speed = PROGRAM2_SPEED;
+  settings.program = 0;
+}
+
+void load_settings() {
+  if (!settings_store.load(settings) || settings.version != SETTINGS_VERSION) {
+    reset_settings();
+    return;
+  }
+
+  // Saved by a build with other ranges
+  for (uint8_t i = 0; i < SETTINGS; i++) {
+    if (!set_setting(i, get_setting(i))) {
+      reset_settings();
+      return;
+    }
+  }
+}
+
+void save_settings() {
+  settings_store.save(settings);
+}
+
+void poll_settings(unsigned long now) {
+  settings_store.poll(now);
+}
+
+uint8_t setting_count() {
+  return SETTINGS;
+}
+
+const __FlashStringHelper *setting_name(uint8_t index) {
+  return reinterpret_cast<const __FlashStringHelper *>(pgm_read_ptr(&setting_info[index].name));
+}
+
+int find_setting(const char *name) {
+  for (uint8_t i = 0; i < SETTINGS; i++) {
+    if (!strcmp_P(name, (PGM_P)pgm_read_ptr(&setting_info[i].name))) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+uint16_t get_setting(uint8_t index) {
+  uint8_t offset = pgm_read_byte(&setting_info[index].offset);
+  uint16_t value;
+  memcpy(&value, (uint8_t *)&settings + offset, sizeof(value));
+  return value;
+}
+
+bool set_setting(uint8_t index, long value) {
+  SettingInfo info;
+  memcpy_P(&info, &setting_info[index], sizeof(info));
+  if (value < info.min || value > info.max) {
+    return false;
+  }
+
+  uint16_t v = value;
+  memcpy((uint8_t *)&settings + info.offset, &v, sizeof(v));
+  return true;
+}
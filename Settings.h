@@ -0,0 +1,66 @@
+/*
+ * Settings.h
+ *
+ * The settings each installation can tune without a reflash: range
+ * thresholds, fade timings and the program to start in.
+ *
+ * They're kept in EEPROM (in an EEPROMStore, so each save is deferred,
+ * wear-leveled and CRC checked) and loaded into RAM once by setup(). The
+ * programs read them straight from the settings struct. If what's in the
+ * EEPROM is missing, corrupt or from another SETTINGS_VERSION, the defaults
+ * are used instead.
+ *
+ * Every setting has a name and range, so the serial console (Console.h) can
+ * list and change them.
+ */
+
+#ifndef Settings_H_
+#define Settings_H_
+
+#include "Arduino.h"
+
+// Change this whenever the Settings struct changes, so old blocks are ignored
+#define SETTINGS_VERSION 1
+
+struct Settings {
+  uint8_t version;
+
+  uint16_t close_range;        // mm, full brightness closer than this
+  uint16_t med_range;          // mm, dim brightness closer than this
+  uint16_t hysteresis;         // mm past med_range to be out of range again
+  uint16_t out_of_range_delay; // ms to wait before fading out
+  uint16_t fade_speed;         // ms to fade on/off when someone walks up/away
+  uint16_t min_interval;       // ms between steps of a fade
+  uint16_t program2_speed;     // ms for each of program 2's color changes
+  uint16_t program;            // The program started at power up (the last one used)
+};
+
+// The settings in use
+extern Settings settings;
+
+// Load the settings from the EEPROM, or the defaults if there aren't any valid ones
+void load_settings();
+
+// Go back to the defaults (call save_settings() to keep them)
+void reset_settings();
+
+// Save the settings to the EEPROM, once they've stopped changing
+void save_settings();
+
+// Write saved settings to the EEPROM. Call it every loop().
+void poll_settings(unsigned long now);
+
+// The number of settings that have names
+uint8_t setting_count();
+
+// The name of a setting (in program memory)
+const __FlashStringHelper *setting_name(uint8_t index);
+
+// Find a setting by name. Returns -1 if there isn't one.
+int find_setting(const char *name);
+
+// Get or set a setting by its index. Returns FALSE if the value is out of the setting's range.
+uint16_t get_setting(uint8_t index);
+bool set_setting(uint8_t index, long value);
+
+#endif /* Settings_H_ */
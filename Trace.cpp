@@ -0,0 +1,116 @@
+/*
+ * Trace.cpp
+ *
+ * Records the IR and sonar bytes read, to replay on the host. See Trace.h
+ */
+
+#include "Log.h"
+#include "Trace.h"
+
+#if TRACE
+
+Tracer tracer;
+
+// Bytes of the trace printed to a line
+#define TRACE_LINE_BYTES 24
+
+const char hex_digits[] PROGMEM = "0123456789abcdef";
+
+Tracer::Tracer() {
+  recording = true;
+  dropped = 0;
+  head = 0;
+  count = 0;
+  start_time = 0;
+  last_time = 0;
+}
+
+void Tracer::put(uint8_t first, uint8_t second) {
+
+  // Make room, moving the start of the trace on by however long the oldest event waited
+  if (count == TRACE_BUFFER_SIZE) {
+    uint8_t oldest = ring[head];
+    if (oldest >> 6 == TRACE_WAIT) {
+      start_time += (unsigned int)(oldest & TRACE_SHORT_DELAY) << 8 | ring[head + 1];
+    }
+    else {
+      start_time += oldest & TRACE_SHORT_DELAY;
+    }
+    head = (head + 2) & (TRACE_BUFFER_SIZE - 1);
+    count -= 2;
+    dropped++;
+  }
+
+  uint16_t tail = (head + count) & (TRACE_BUFFER_SIZE - 1);
+  ring[tail] = first;
+  ring[tail + 1] = second;
+  count += 2;
+}
+
+int Tracer::record(uint8_t source, int value) {
+  if (!recording || value < 0) {
+    return value;
+  }
+
+  unsigned long now = millis();
+  unsigned long delay = now - last_time;
+  last_time = now;
+
+  // A gap longer than the whole ring could hold in waits: start the trace over from now
+  if (delay / TRACE_LONG_DELAY >= TRACE_BUFFER_SIZE / 2 - 1) {
+    dropped += count / 2;
+    head = 0;
+    count = 0;
+    start_time = now;
+    delay = 0;
+  }
+
+  while (delay > TRACE_SHORT_DELAY) {
+    unsigned int wait = delay > TRACE_LONG_DELAY ? TRACE_LONG_DELAY : delay;
+    put(TRACE_WAIT << 6 | wait >> 8, wait);
+    delay -= wait;
+  }
+  put(source << 6 | delay, value);
+  return value;
+}
+
+void Tracer::clear() {
+  head = 0;
+  count = 0;
+  dropped = 0;
+  start_time = last_time = millis();
+  recording = true;
+}
+
+bool Tracer::report(uint16_t line) {
+  uint16_t size = TRACE_HEADER_SIZE + count;
+  uint16_t lines = (size + TRACE_LINE_BYTES - 1) / TRACE_LINE_BYTES;
+
+  if (line == lines) {
+    logger.printf(F("Traced %u events, %lu dropped"), count / 2, dropped);
+    return true;
+  }
+  if (line > lines) {
+    return false;
+  }
+
+  uint8_t header[TRACE_HEADER_SIZE] = {
+    'B', 'B', 'T', TRACE_VERSION,
+    (uint8_t)start_time, (uint8_t)(start_time >> 8),
+    (uint8_t)(start_time >> 16), (uint8_t)(start_time >> 24)
+  };
+
+  char text[2 * TRACE_LINE_BYTES + 1];
+  char *p = text;
+  for (uint16_t i = line * TRACE_LINE_BYTES; i < size && p < text + 2 * TRACE_LINE_BYTES; i++) {
+    uint8_t b = i < TRACE_HEADER_SIZE ? header[i] :
+        ring[(head + i - TRACE_HEADER_SIZE) & (TRACE_BUFFER_SIZE - 1)];
+    *p++ = pgm_read_byte(&hex_digits[b >> 4]);
+    *p++ = pgm_read_byte(&hex_digits[b & 0xF]);
+  }
+  *p = 0;
+  logger.printf(F("trace %s"), text);
+  return true;
+}
+
+#endif
@@ -0,0 +1,113 @@
+/*
+ * Trace.h
+ *
+ * Records the bytes the firmware reads from the IR receiver (Serial1) and
+ * the sonar (Serial2), with the millis() each was read at, so a run on the
+ * wall can be played back on the host (bookshelf_sim --replay) and step
+ * for step give the same PWM output.
+ *
+ * Each byte read goes through TRACE_INPUT(source, byte), which adds it to a
+ * ring of TRACE_BUFFER_SIZE bytes in RAM. Once the ring is full the oldest
+ * events make room, so it always holds the last stretch: a sonar frame is
+ * 6 events, 12 bytes, every 150ms, so 1024 bytes is about 12 seconds with
+ * the odd IR code. A gap longer than the ring could hold in TRACE_WAIT
+ * events (about 2 hours) starts it over. The console's "trace" command
+ * prints it (see Console.h) and "trace clear" empties it. Recording starts
+ * at power up and stops while the trace is printed.
+ *
+ * A trace is a header and 2 bytes per event:
+ *
+ *   'B' 'B' 'T' 1          Magic and version
+ *   4 bytes                millis() the first event's delay counts from, little endian
+ *   SSDDDDDD VVVVVVVV      Source S (TRACE_IR or TRACE_SONAR), D milliseconds
+ *                          after the event before, and the byte V that was read
+ *   11DDDDDD DDDDDDDD      TRACE_WAIT: D (14 bits) more milliseconds passed
+ *
+ * "trace" prints it as hex, "trace " and 24 bytes to a line, so the serial
+ * log can be handed to --replay as it is.
+ *
+ * Built with TRACE 0 (the default), TRACE_INPUT is just the byte and none of
+ * this is compiled in.
+ */
+
+#ifndef Trace_H_
+#define Trace_H_
+
+#include "Arduino.h"
+
+#ifndef TRACE
+#define TRACE 0
+#endif
+
+// Bytes of RAM the ring takes (a power of 2)
+#ifndef TRACE_BUFFER_SIZE
+#define TRACE_BUFFER_SIZE 1024
+#endif
+
+#if TRACE_BUFFER_SIZE & (TRACE_BUFFER_SIZE - 1)
+#error TRACE_BUFFER_SIZE must be a power of 2
+#endif
+
+// Where an event's byte came from
+#define TRACE_IR 0     // Serial1
+#define TRACE_SONAR 1  // Serial2
+#define TRACE_WAIT 3   // Nothing, time passing
+
+#define TRACE_VERSION 1
+#define TRACE_HEADER_SIZE 8
+
+// Most milliseconds a TRACE_IR/TRACE_SONAR event and a TRACE_WAIT event can be after the last
+#define TRACE_SHORT_DELAY 0x3F
+#define TRACE_LONG_DELAY 0x3FFF
+
+#if TRACE
+
+class Tracer {
+  uint8_t ring[TRACE_BUFFER_SIZE];
+  uint16_t head;   // Oldest event
+  uint16_t count;  // Bytes in the ring
+
+  // millis() before the oldest event, and at the newest
+  unsigned long start_time;
+  unsigned long last_time;
+
+  bool recording;
+
+  // Events pushed out of the ring to make room
+  unsigned long dropped;
+
+  void put(uint8_t first, uint8_t second);
+
+public:
+  Tracer();
+
+  // Record a byte read from a source. Returns the byte (or -1 for nothing read, which isn't
+  // recorded), to read and record in one go.
+  int record(uint8_t source, int value);
+
+  // Forget everything recorded, and record from now on
+  void clear();
+
+  // Stop recording (and start again), so a trace printed over several loops is all of a piece
+  void hold(bool on) { recording = !on; }
+
+  // Events in the ring, and events dropped to make room (or when a long gap started it over)
+  uint16_t get_events() { return count / 2; }
+  unsigned long get_dropped() { return dropped; }
+
+  // The printed trace is a line of hex per 24 bytes, then a summary. Log line n of it and
+  // return TRUE, or FALSE once there are no more.
+  bool report(uint16_t line);
+};
+
+extern Tracer tracer;
+
+#define TRACE_INPUT(source, value) tracer.record(source, value)
+
+#else
+
+#define TRACE_INPUT(source, value) (value)
+
+#endif
+
+#endif /* Trace_H_ */
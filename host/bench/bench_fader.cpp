@@ -0,0 +1,231 @@
+/*
+ * bench_fader.cpp
+ *
+ * Cycles per LEDFader::update(), compared against the float engine LEDFader
+ * started out with (kept here verbatim as FloatFader). LEDFader now steps on
+ * an integer schedule worked out by fade(), so update() only adds and
+ * compares, and the check that no step is due yet is inlined into the
+ * caller. The ratio is float / LEDFader: above 1 means LEDFader is faster.
+ * The size of each on the host is printed too (on the AVR, 17 bytes for
+ * the float engine and 18 for LEDFader).
+ *
+ * Each case runs a full fade with the virtual clock advancing a fixed amount
+ * between update() calls: 1ms is a loop() that mostly finds the interval
+ * hasn't passed yet, 20ms (MIN_INTERVAL) steps the color on every call.
+ *
+ * The second table is a FaderBank of 12 channels (the shelves' 4 x RGB) on
+ * 8-bit pins fading 0 -> 30 and holding there, with and without dithering,
+ * in cycles per update() called every 1ms.
+ *
+ * Cycles are host TSC ticks, the best of TRIALS runs. The host has an FPU,
+ * so the float engine looks far cheaper here than it is on the ATmega2560,
+ * where every float divide and round() is a soft-float library call.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "Arduino.h"
+#include "Sim.h"
+#include "LEDFader.h"
+#include "FaderBank.h"
+
+#define PIN 3
+
+static uint64_t cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+// Keep the reference engine out of line, as it was in LEDFader.cpp, so the loop can't inline it away
+#define NOINLINE __attribute__((noinline))
+
+/**
+ * The float fade engine, as LEDFader shipped it originally
+ */
+class FloatFader {
+  typedef uint8_t (*curve_function)(uint8_t);
+
+  uint8_t pin;
+  unsigned long last_step_time;
+  unsigned int interval;
+  uint8_t color;
+  uint8_t to_color;
+  unsigned int duration;
+  float percent_done;
+  curve_function curve;
+
+public:
+  FloatFader(uint8_t pwm_pin) {
+    pin = pwm_pin;
+    color = 0;
+    to_color = 0;
+    last_step_time = 0;
+    interval = 0;
+    duration = 0;
+    percent_done = 0;
+    curve = (curve_function)0;
+  }
+
+  NOINLINE void set_value(int value) {
+    if (!pin) return;
+    color = (uint8_t)constrain(value, 0, 255);
+    if (curve)
+     analogWrite(pin, curve(color));
+    else
+    analogWrite(pin, color);
+  }
+
+  NOINLINE void stop_fade() {
+    percent_done = 100;
+    duration = 0;
+  }
+
+  NOINLINE void fade(uint8_t value, unsigned int time) {
+    stop_fade();
+    percent_done = 0;
+    if (value == color) {
+      return;
+    }
+    if (time <= MIN_INTERVAL) {
+      set_value(value);
+      return;
+    }
+    duration = time;
+    to_color = (uint8_t)constrain(value, 0, 255);
+    float color_diff = abs(color - to_color);
+    interval = round((float)duration / color_diff);
+    if (interval < MIN_INTERVAL) {
+      interval = MIN_INTERVAL;
+    }
+    last_step_time = millis();
+  }
+
+  NOINLINE bool update() {
+    if (duration == 0) {
+      return false;
+    }
+    unsigned long now = millis();
+    unsigned int time_diff = now - last_step_time;
+    if (time_diff < interval) {
+      return true;
+    }
+    float percent = (float)time_diff / (float)duration;
+    percent_done += percent;
+    if (percent >= 1) {
+      stop_fade();
+      set_value(to_color);
+      return false;
+    }
+    int color_diff = to_color - color;
+    int increment = round(color_diff * percent);
+    set_value(color + increment);
+    duration -= time_diff;
+    last_step_time = millis();
+    return true;
+  }
+};
+
+struct Case {
+  uint8_t from;
+  uint8_t to;
+  unsigned int duration;
+};
+
+static const Case cases[] = {
+  { 0, 255, 2000 },  // Program0 close range
+  { 0, 30, 2000 },   // Program0 medium range
+  { 255, 0, 3000 },  // Program2 cross fade
+  { 40, 180, 1500 }, // Program1 random fade
+};
+
+#define REPEAT 2000
+#define TRIALS 15
+
+// Average cycles per update() over full fades, advancing the clock by step_ms between calls
+template <class Fader>
+static double bench(const Case &c, unsigned long step_ms) {
+  uint64_t total = 0;
+  unsigned long calls = 0;
+
+  for (int r = 0; r < REPEAT; r++) {
+    Fader fader(PIN);
+    fader.set_value(c.from);
+    fader.fade(c.to, c.duration);
+
+    // Time the whole fade at once; reading the TSC around every call costs more than update() does
+    bool fading = true;
+    uint64_t start = cycles();
+    while (fading) {
+      sim::advance_ms(step_ms);
+      fading = fader.update();
+      calls++;
+    }
+    total += cycles() - start;
+  }
+  return (double)total / calls;
+}
+
+// Average cycles per update() of a 12 channel bank fading 0 -> 30 over 2s and holding it
+// for another 2s, advancing the clock 1ms between calls
+static double bench_bank(bool dithered) {
+  static const uint8_t pins[12] = { 4, 3, 2, 5, 7, 6, 8, 9, 10, 11, 12, 13 };
+  uint64_t total = 0;
+  unsigned long calls = 0;
+
+  for (int r = 0; r < REPEAT / 10; r++) {
+    FaderBank<4, 3> bank(pins);
+    for (uint8_t ch = 0; ch < 12; ch++) {
+      bank.set_dither(ch, dithered);
+    }
+    const uint8_t dim[3] = { 30, 30, 30 };
+    bank.fade_all(dim, 2000);
+
+    uint64_t start = cycles();
+    for (int ms = 0; ms < 4000; ms++) {
+      sim::advance_ms(1);
+      bank.update(millis());
+      calls++;
+    }
+    total += cycles() - start;
+  }
+  return (double)total / calls;
+}
+
+int main() {
+  sim::reset();
+
+  printf("%-14s %7s %12s %12s %8s\n", "fade", "step", "float", "LEDFader", "ratio");
+  printf("%-14s %7s %12zu %12zu\n", "host bytes", "", sizeof(FloatFader), sizeof(LEDFader));
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    const Case &c = cases[i];
+    unsigned long steps[] = { 1, MIN_INTERVAL };
+
+    for (int s = 0; s < 2; s++) {
+      // Best of a few runs each, taken in turn, so a busy moment on the host doesn't count
+      double old_engine = 0, fixed = 0;
+      for (int t = 0; t < TRIALS; t++) {
+        double f = bench<FloatFader>(c, steps[s]);
+        double l = bench<LEDFader>(c, steps[s]);
+        old_engine = (!t || f < old_engine) ? f : old_engine;
+        fixed = (!t || l < fixed) ? l : fixed;
+      }
+
+      char name[32];
+      snprintf(name, sizeof(name), "%u->%u/%ums", c.from, c.to, c.duration);
+      printf("%-14s %5lums %12.1f %12.1f %7.2fx\n", name, steps[s], old_engine, fixed, old_engine / fixed);
+    }
+  }
+
+  printf("\n%-14s %7s %12s %12s\n", "bank of 12", "step", "plain", "dithered");
+  printf("%-14s %5dms %12.1f %12.1f\n", "0->30/2000ms", 1, bench_bank(false), bench_bank(true));
+  return 0;
+}
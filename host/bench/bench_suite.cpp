@@ -0,0 +1,405 @@
+/*
+ * bench_suite.cpp
+ *
+ * The hot paths of the firmware, timed on the host, with a stored baseline
+ * to catch regressions.
+ *
+ *   bench_suite [--baseline FILE] [--write-baseline FILE] [--tolerance PCT]
+ *
+ * Each case prints one line on stdout:
+ *
+ *   <case> <cycles per operation> <PWM writes per operation>
+ *
+ * Cycles are host TSC ticks (nanoseconds where there's no TSC) divided by
+ * the ticks a chain of dependent adds takes per add, timed just before each
+ * run: the TSC runs at a fixed rate while the core's clock doesn't, so raw
+ * ticks wander by 2x from one run to the next. Each case is the median of
+ * RUNS runs, taken in turn with the other cases' so they're spread over the
+ * whole suite. PWM writes come from the stand-in core and don't depend on the
+ * machine. The cases:
+ *
+ *   fade/FROM-TO/MS          LEDFader::fade()
+ *   update/FROM-TO/MS/STEP   LEDFader::update() over a whole fade, the clock
+ *                            moving STEP ms between calls
+ *   curve/NAME               One Curve function call
+ *   fade_all/MODE            fade_all() of every shelf, RGB or round the hues
+ *   loop/programN            One loop() of the whole firmware in program N
+ *
+ * With --baseline, every case is compared against the file (the same
+ * format, '#' starts a comment). Taking more than TOLERANCE percent and
+ * MIN_REGRESSION more cycles, or making any more PWM writes, is a
+ * regression, and the run exits with status 1. The tolerance is 50% by
+ * default: on a shared machine, whole runs come out 20 - 40% apart. Cases
+ * the baseline doesn't have are only reported. --write-baseline saves this
+ * run as the new baseline. Cycles are only comparable on the same machine
+ * and compiler, so record a baseline before making changes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "Arduino.h"
+#include "Sim.h"
+#include "Scenario.h"
+#include "BoozeBookshelf.h"
+
+#define PIN 3
+#define RUNS 7
+
+// Fewer extra cycles than this is noise, whatever percentage it is (a Curve call takes about 4)
+#define MIN_REGRESSION 5
+
+static uint64_t cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+// Ticks per add of a chain of adds that each wait for the last (one cycle each)
+#define CALIBRATE_ADDS 200000
+
+static double ticks_per_cycle() {
+  uint32_t x = 0;
+  uint64_t start = cycles();
+  for (uint32_t i = 0; i < CALIBRATE_ADDS; i++) {
+    x += i;
+    __asm__ volatile("" : "+r"(x));
+  }
+  return (double)(cycles() - start) / CALIBRATE_ADDS;
+}
+
+struct Result {
+  std::string name;
+  double cycles;
+  double writes;
+};
+
+static std::vector<Result> results;
+
+// Ticks and writes of one run of a case, for so many operations
+struct Run {
+  uint64_t ticks;
+  unsigned long writes;
+  unsigned long ops;
+};
+
+struct Case {
+  std::string name;
+  std::function<Run()> body;
+};
+
+static std::vector<Case> cases;
+
+static void add_case(const char *name, std::function<Run()> body) {
+  Case c = { name, body };
+  cases.push_back(c);
+}
+
+// Run every case RUNS times, a run of each in turn, and take the median of each case's runs.
+// Each run is calibrated either side: the clock can still change during one, and that's as
+// likely to make it look faster as slower.
+static void measure_all() {
+  std::vector<std::vector<double> > c(cases.size());
+  results.resize(cases.size());
+
+  for (int i = 0; i < RUNS; i++) {
+    for (size_t n = 0; n < cases.size(); n++) {
+      double before = ticks_per_cycle();
+      Run run = cases[n].body();
+      double after = ticks_per_cycle();
+      c[n].push_back(run.ticks / ((before + after) / 2) / run.ops);
+      results[n].writes = (double)run.writes / run.ops;
+    }
+  }
+
+  for (size_t n = 0; n < cases.size(); n++) {
+    std::sort(c[n].begin(), c[n].end());
+    results[n].name = cases[n].name;
+    results[n].cycles = c[n][RUNS / 2];
+    printf("%s %.1f %.3f\n", results[n].name.c_str(), results[n].cycles, results[n].writes);
+  }
+}
+
+struct Fade {
+  uint8_t from;
+  uint8_t to;
+  unsigned int duration;
+};
+
+// The same fades bench_fader compares
+static const Fade fades[] = {
+  { 0, 255, 2000 },  // Program0 close range
+  { 0, 30, 2000 },   // Program0 medium range
+  { 255, 0, 3000 },  // Program2 cross fade
+  { 40, 180, 1500 }, // Program1 random fade
+};
+
+#define FADE_CALLS 100000
+
+static Run run_fade(const Fade &f) {
+  sim::reset();
+  LEDFader fader(PIN);
+  fader.set_value(f.from);
+  unsigned long writes = sim::pwm_writes();
+
+  // Nothing steps in between, so every call plans the same fade from the same value
+  uint64_t start = cycles();
+  for (int i = 0; i < FADE_CALLS; i++) {
+    fader.fade(f.to, f.duration);
+  }
+  Run run = { cycles() - start, sim::pwm_writes() - writes, FADE_CALLS };
+  return run;
+}
+
+#define UPDATE_FADES 500
+
+static Run run_update(const Fade &f, unsigned long step_ms) {
+  sim::reset();
+  LEDFader fader(PIN);
+  Run run = { 0, 0, 0 };
+
+  for (int i = 0; i < UPDATE_FADES; i++) {
+    fader.set_value(f.from);
+    fader.fade(f.to, f.duration);
+    unsigned long writes = sim::pwm_writes();
+
+    // Time the whole fade at once; reading the TSC around every call costs more than update() does
+    bool fading = true;
+    uint64_t start = cycles();
+    while (fading) {
+      sim::advance_ms(step_ms);
+      fading = fader.update();
+      run.ops++;
+    }
+    run.ticks += cycles() - start;
+    run.writes += sim::pwm_writes() - writes;
+  }
+  return run;
+}
+
+#define CURVE_PASSES 2000
+
+static Run run_curve(uint8_t (*curve)(uint8_t)) {
+  volatile uint8_t sink = 0;
+  uint64_t start = cycles();
+  for (int pass = 0; pass < CURVE_PASSES; pass++) {
+    for (int i = 0; i < 256; i++) {
+      sink = sink + curve(i);
+    }
+  }
+  Run run = { cycles() - start, 0, CURVE_PASSES * 256UL };
+  return run;
+}
+
+static Run run_curve16(uint16_t (*curve)(uint16_t)) {
+  volatile uint16_t sink = 0;
+  uint64_t start = cycles();
+  for (int pass = 0; pass < CURVE_PASSES; pass++) {
+    for (uint32_t i = 0; i < 65536; i += 257) {
+      sink = sink + curve(i);
+    }
+  }
+  Run run = { cycles() - start, 0, CURVE_PASSES * 256UL };
+  return run;
+}
+
+#define FADE_ALL_CALLS 10000
+
+static Run run_fade_all(byte mode) {
+  sim::reset();
+  setup();
+  start_program(1);
+  set_fade_mode(mode);
+  unsigned long writes = sim::pwm_writes();
+
+  // Back and forth between two colors a hue fade takes the long way between
+  uint64_t start = cycles();
+  for (int i = 0; i < FADE_ALL_CALLS; i++) {
+    if (i & 1) {
+      fade_all(0, 0, 255, 2000);
+    } else {
+      fade_all(255, 200, 0, 2000);
+    }
+    sim::advance_ms(1);
+    shelves.update(millis());
+  }
+  Run run = { cycles() - start, sim::pwm_writes() - writes, FADE_ALL_CALLS };
+  return run;
+}
+
+// Warm up for WARMUP_MS, then time loop() for LOOP_MS of virtual time
+#define WARMUP_MS 3000
+#define LOOP_MS 20000
+
+static Run run_loop(char code) {
+  Scenario scenario;
+  scenario.time_loops = false;
+  randomSeed(1);
+
+  // Someone walks up, hangs around at medium range, and leaves
+  scenario.range(0, 600);
+  scenario.range(8000, 950);
+  scenario.range(16000, 2000);
+  if (code) {
+    scenario.ir(100, code);
+  }
+  scenario.start();
+  scenario.run_until(WARMUP_MS);
+
+  unsigned long loops = scenario.loops;
+  unsigned long writes = sim::pwm_writes();
+  uint64_t start = cycles();
+  scenario.run_until(WARMUP_MS + LOOP_MS);
+  Run run = { cycles() - start, sim::pwm_writes() - writes, scenario.loops - loops };
+  return run;
+}
+
+static bool load_baseline(const char *path, std::map<std::string, Result> &baseline) {
+  FILE *f = fopen(path, "r");
+  if (!f) return false;
+
+  char line[256];
+  while (fgets(line, sizeof(line), f)) {
+    char name[128];
+    Result r;
+    if (line[0] == '#') continue;
+    if (sscanf(line, "%127s %lf %lf", name, &r.cycles, &r.writes) == 3) {
+      r.name = name;
+      baseline[r.name] = r;
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+static bool write_baseline(const char *path) {
+  FILE *f = fopen(path, "w");
+  if (!f) return false;
+
+  fprintf(f, "# bench_suite baseline: <case> <cycles per operation> <PWM writes per operation>\n");
+  fprintf(f, "# Cycles only compare on the machine that recorded them (make bench-baseline)\n");
+  for (size_t i = 0; i < results.size(); i++) {
+    fprintf(f, "%s %.1f %.3f\n", results[i].name.c_str(), results[i].cycles, results[i].writes);
+  }
+  fclose(f);
+  return true;
+}
+
+// Returns the number of regressions against the baseline
+static int compare(const std::map<std::string, Result> &baseline, double tolerance) {
+  int regressions = 0;
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result &r = results[i];
+    std::map<std::string, Result>::const_iterator b = baseline.find(r.name);
+    if (b == baseline.end()) {
+      fprintf(stderr, "%s: not in the baseline\n", r.name.c_str());
+      continue;
+    }
+
+    double change = (r.cycles / b->second.cycles - 1) * 100;
+    if (change > tolerance && r.cycles - b->second.cycles > MIN_REGRESSION) {
+      fprintf(stderr, "%s: REGRESSION, %.1f cycles against %.1f (%+.0f%%)\n",
+          r.name.c_str(), r.cycles, b->second.cycles, change);
+      regressions++;
+    }
+    if (r.writes > b->second.writes + 0.0005) {
+      fprintf(stderr, "%s: REGRESSION, %.3f PWM writes against %.3f\n",
+          r.name.c_str(), r.writes, b->second.writes);
+      regressions++;
+    }
+  }
+  return regressions;
+}
+
+int main(int argc, char **argv) {
+  const char *baseline_path = 0;
+  const char *write_path = 0;
+  double tolerance = 50;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--baseline") && i + 1 < argc) {
+      baseline_path = argv[++i];
+    } else if (!strcmp(argv[i], "--write-baseline") && i + 1 < argc) {
+      write_path = argv[++i];
+    } else if (!strcmp(argv[i], "--tolerance") && i + 1 < argc) {
+      tolerance = atof(argv[++i]);
+    } else {
+      fprintf(stderr, "usage: %s [--baseline FILE] [--write-baseline FILE] [--tolerance PCT]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  // Read the baseline first, so a bad path doesn't wait for the whole run
+  std::map<std::string, Result> baseline;
+  if (baseline_path && !load_baseline(baseline_path, baseline)) {
+    fprintf(stderr, "Can't read %s\n", baseline_path);
+    return 2;
+  }
+
+  char name[64];
+  for (size_t i = 0; i < sizeof(fades) / sizeof(fades[0]); i++) {
+    Fade f = fades[i];
+    snprintf(name, sizeof(name), "fade/%u-%u/%u", f.from, f.to, f.duration);
+    add_case(name, [f] { return run_fade(f); });
+  }
+
+  for (size_t i = 0; i < sizeof(fades) / sizeof(fades[0]); i++) {
+    Fade f = fades[i];
+    unsigned long steps[] = { 1, MIN_INTERVAL };
+    for (int s = 0; s < 2; s++) {
+      unsigned long step = steps[s];
+      snprintf(name, sizeof(name), "update/%u-%u/%u/%lu", f.from, f.to, f.duration, step);
+      add_case(name, [f, step] { return run_update(f, step); });
+    }
+  }
+
+  add_case("curve/exponential", [] { return run_curve(Curve::exponential); });
+  add_case("curve/linear", [] { return run_curve(Curve::linear); });
+  add_case("curve/reverse", [] { return run_curve(Curve::reverse); });
+  add_case("curve/exponential16", [] { return run_curve16(Curve::exponential16); });
+
+  add_case("fade_all/rgb", [] { return run_fade_all(FADE_RGB); });
+  add_case("fade_all/hue", [] { return run_fade_all(FADE_HUE); });
+
+  const char codes[] = { 0, IR_A, IR_B, IR_C };
+  for (int p = 0; p < 4; p++) {
+    char code = codes[p];
+    snprintf(name, sizeof(name), "loop/program%d", p);
+    add_case(name, [code] { return run_loop(code); });
+  }
+
+  printf("# <case> <cycles per operation> <PWM writes per operation>\n");
+  measure_all();
+
+  if (write_path) {
+    if (!write_baseline(write_path)) {
+      fprintf(stderr, "Can't write %s\n", write_path);
+      return 2;
+    }
+    fprintf(stderr, "Baseline written to %s\n", write_path);
+  }
+
+  if (baseline_path) {
+    int regressions = compare(baseline, tolerance);
+    if (regressions) {
+      fprintf(stderr, "%d regression(s) against %s\n", regressions, baseline_path);
+      return 1;
+    }
+    fprintf(stderr, "No regressions against %s\n", baseline_path);
+  }
+  return 0;
+}
@@ -0,0 +1,235 @@
+/*
+ * Arduino.cpp
+ *
+ * Host stand-in for the Arduino AVR core: virtual clock, captured pin
+ * outputs and an in-memory EEPROM.
+ */
+
+#include <avr/eeprom.h>
+#include <avr/io.h>
+#include "Arduino.h"
+#include "Sim.h"
+
+// Time an EEPROM byte write keeps the EEPROM busy (ATmega2560 datasheet, 3.3 ms)
+#define EEPROM_WRITE_US 3300
+
+static uint64_t clock_us = 0;
+
+static uint16_t pin_pwm[NUM_DIGITAL_PINS];
+static unsigned long pin_writes[NUM_DIGITAL_PINS];
+static unsigned long total_writes = 0;
+static sim::pwm_listener listener = NULL;
+
+static int analog_in[16];
+
+// The 16-bit timers, and the pins their channels A, B and C drive
+#define TIMER_REGISTERS(n, pin_a, pin_b, pin_c) \
+  volatile uint8_t TCCR##n##A = 0; \
+  volatile uint8_t TCCR##n##B = 0; \
+  volatile uint16_t ICR##n = 0; \
+  SimOCR OCR##n##A(pin_a, TCCR##n##A, ICR##n, COM1A1); \
+  SimOCR OCR##n##B(pin_b, TCCR##n##A, ICR##n, COM1B1); \
+  SimOCR OCR##n##C(pin_c, TCCR##n##A, ICR##n, COM1C1);
+
+TIMER_REGISTERS(1, 11, 12, 13)
+TIMER_REGISTERS(3, 5, 2, 3)
+TIMER_REGISTERS(4, 6, 7, 8)
+TIMER_REGISTERS(5, 46, 45, 44)
+
+static volatile uint8_t *const timer_control[] = { &TCCR1A, &TCCR1B, &TCCR3A, &TCCR3B, &TCCR4A, &TCCR4B, &TCCR5A, &TCCR5B };
+static volatile uint16_t *const timer_top[] = { &ICR1, &ICR3, &ICR4, &ICR5 };
+static SimOCR *const timer_compare[] = {
+  &OCR1A, &OCR1B, &OCR1C, &OCR3A, &OCR3B, &OCR3C, &OCR4A, &OCR4B, &OCR4C, &OCR5A, &OCR5B, &OCR5C
+};
+
+// A pin's output changed to a duty cycle
+static void output(uint8_t pin, uint16_t duty) {
+  pin_pwm[pin] = duty;
+  pin_writes[pin]++;
+  total_writes++;
+  if (listener) {
+    listener(clock_us, pin, duty);
+  }
+}
+
+SimOCR &SimOCR::operator=(uint16_t v) {
+  value = v;
+  if (tccra & _BV(com)) {
+    uint32_t duty = ((uint32_t)v + 1) * 65536 / ((uint32_t)icr + 1);
+    output(pin, duty > 0xFFFF ? 0xFFFF : duty);
+  }
+  return *this;
+}
+
+static uint8_t eeprom_cells[E2END + 1];
+static unsigned long eeprom_write_count = 0;
+static uint64_t eeprom_busy_until = 0;
+
+/*
+ -------------------------
+ Simulation control
+ -------------------------
+*/
+
+void sim::reset() {
+  clock_us = 0;
+  memset(pin_pwm, 0, sizeof(pin_pwm));
+  memset(pin_writes, 0, sizeof(pin_writes));
+  total_writes = 0;
+  memset(analog_in, 0, sizeof(analog_in));
+  for (unsigned i = 0; i < sizeof(timer_control) / sizeof(timer_control[0]); i++) {
+    *timer_control[i] = 0;
+  }
+  for (unsigned i = 0; i < sizeof(timer_top) / sizeof(timer_top[0]); i++) {
+    *timer_top[i] = 0;
+  }
+  for (unsigned i = 0; i < sizeof(timer_compare) / sizeof(timer_compare[0]); i++) {
+    timer_compare[i]->value = 0;
+  }
+  memset(eeprom_cells, 0xFF, sizeof(eeprom_cells));
+  eeprom_write_count = 0;
+  eeprom_busy_until = 0;
+
+  Serial.reset();
+  Serial1.reset();
+  Serial2.reset();
+  Serial3.reset();
+}
+
+uint64_t sim::now_us() {
+  return clock_us;
+}
+
+void sim::advance_us(uint64_t us) {
+  clock_us += us;
+}
+
+void sim::advance_ms(unsigned long ms) {
+  clock_us += (uint64_t)ms * 1000;
+}
+
+int sim::pwm(uint8_t pin) {
+  if (pin >= NUM_DIGITAL_PINS) return 0;
+  return pin_pwm[pin];
+}
+
+unsigned long sim::pwm_writes(uint8_t pin) {
+  if (pin >= NUM_DIGITAL_PINS) return 0;
+  return pin_writes[pin];
+}
+
+unsigned long sim::pwm_writes() {
+  return total_writes;
+}
+
+void sim::on_pwm(pwm_listener l) {
+  listener = l;
+}
+
+void sim::set_analog(uint8_t pin, int value) {
+  if (pin < 16) analog_in[pin] = value;
+}
+
+uint8_t *sim::eeprom() {
+  return eeprom_cells;
+}
+
+size_t sim::eeprom_size() {
+  return sizeof(eeprom_cells);
+}
+
+unsigned long sim::eeprom_writes() {
+  return eeprom_write_count;
+}
+
+/*
+ -------------------------
+ Arduino API
+ -------------------------
+*/
+
+void pinMode(uint8_t, uint8_t) {
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  analogWrite(pin, val ? 255 : 0);
+}
+
+int digitalRead(uint8_t pin) {
+  return sim::pwm(pin) ? HIGH : LOW;
+}
+
+int analogRead(uint8_t pin) {
+  if (pin >= 16) return 0;
+  return analog_in[pin];
+}
+
+void analogWrite(uint8_t pin, int val) {
+  if (pin >= NUM_DIGITAL_PINS) return;
+  output(pin, constrain(val, 0, 255) * 257);
+}
+
+unsigned long millis() {
+  return (unsigned long)(clock_us / 1000);
+}
+
+unsigned long micros() {
+  return (unsigned long)clock_us;
+}
+
+void delay(unsigned long ms) {
+  sim::advance_ms(ms);
+}
+
+void delayMicroseconds(unsigned int us) {
+  sim::advance_us(us);
+}
+
+void randomSeed(unsigned long seed) {
+  if (seed != 0) {
+    srandom(seed);
+  }
+}
+
+long random(long howbig) {
+  if (howbig == 0) return 0;
+  return ::random() % howbig;
+}
+
+long random(long howsmall, long howbig) {
+  if (howsmall >= howbig) return howsmall;
+  return random(howbig - howsmall) + howsmall;
+}
+
+/*
+ -------------------------
+ avr-libc EEPROM
+ -------------------------
+*/
+
+// Like avr-libc, wait for any write still in progress before touching the EEPROM
+static void eeprom_wait() {
+  if (eeprom_busy_until > clock_us) {
+    clock_us = eeprom_busy_until;
+  }
+}
+
+uint8_t eeprom_is_ready(void) {
+  return eeprom_busy_until <= clock_us;
+}
+
+uint8_t eeprom_read_byte(const uint8_t *addr) {
+  uintptr_t address = (uintptr_t)addr;
+  eeprom_wait();
+  if (address > E2END) return 0xFF;
+  return eeprom_cells[address];
+}
+
+void eeprom_write_byte(uint8_t *addr, uint8_t value) {
+  uintptr_t address = (uintptr_t)addr;
+  eeprom_wait();
+  if (address > E2END) return;
+  eeprom_cells[address] = value;
+  eeprom_write_count++;
+  eeprom_busy_until = clock_us + EEPROM_WRITE_US;
+}
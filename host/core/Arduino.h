@@ -0,0 +1,57 @@
+/*
+ * Arduino.h
+ *
+ * Host stand-in for the Arduino AVR core, so the firmware sources can be
+ * compiled and run on Linux. Only the parts of the core the bookshelf uses
+ * are provided. Time is virtual: it only moves when the simulation (see Sim.h)
+ * advances it, or when the firmware calls delay() or blocks on a full serial
+ * TX buffer.
+ */
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <avr/pgmspace.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef uint16_t word;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+// Number of pins on the ATmega2560 board
+#define NUM_DIGITAL_PINS 70
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogWrite(uint8_t pin, int val);
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void randomSeed(unsigned long seed);
+long random(long howbig);
+long random(long howsmall, long howbig);
+
+void setup(void);
+void loop(void);
+
+#include "HardwareSerial.h"
+
+#endif /* Arduino_h */
@@ -0,0 +1,160 @@
+/*
+ * HardwareSerial.cpp
+ *
+ * Host stand-in for the ATmega2560 UARTs.
+ */
+
+#include "Arduino.h"
+#include "Sim.h"
+
+// Baud rate used to pace bytes on a port that hasn't been started yet
+#define DEFAULT_BAUD 115200
+
+HardwareSerial Serial;
+HardwareSerial Serial1;
+HardwareSerial Serial2;
+HardwareSerial Serial3;
+
+HardwareSerial::HardwareSerial() {
+  baud = 0;
+  reset();
+}
+
+void HardwareSerial::reset() {
+  line_head = 0;
+  line_count = 0;
+  rx_head = 0;
+  rx_count = 0;
+  output.clear();
+  line_free_ns = 0;
+  tx_free_ns = 0;
+  rx_overflows = 0;
+  line_overflows = 0;
+  tx_blocked_us = 0;
+}
+
+// Time it takes to shift one byte (start + 8 data + stop bits) at the current baud rate
+uint64_t HardwareSerial::byte_ns() {
+  unsigned long rate = baud ? baud : DEFAULT_BAUD;
+  return 10ULL * 1000000000ULL / rate;
+}
+
+// Move every byte that has arrived by now from the line into the RX buffer
+void HardwareSerial::receive() {
+  uint64_t now = sim::now_us();
+  while (line_count && line[line_head].at_us <= now) {
+    if (rx_count < SERIAL_RX_BUFFER_SIZE) {
+      rx[(rx_head + rx_count) % SERIAL_RX_BUFFER_SIZE] = line[line_head].value;
+      rx_count++;
+    } else {
+      rx_overflows++;
+    }
+    line_head = (line_head + 1) % SIM_LINE_QUEUE_SIZE;
+    line_count--;
+  }
+}
+
+void HardwareSerial::begin(unsigned long baud_rate) {
+  baud = baud_rate;
+}
+
+void HardwareSerial::end() {
+  baud = 0;
+  rx_count = 0;
+}
+
+int HardwareSerial::available() {
+  receive();
+  return rx_count;
+}
+
+int HardwareSerial::peek() {
+  receive();
+  if (!rx_count) return -1;
+  return rx[rx_head];
+}
+
+int HardwareSerial::read() {
+  receive();
+  if (!rx_count) return -1;
+  uint8_t c = rx[rx_head];
+  rx_head = (rx_head + 1) % SERIAL_RX_BUFFER_SIZE;
+  rx_count--;
+  return c;
+}
+
+int HardwareSerial::availableForWrite() {
+  uint64_t now = sim::now_us() * 1000;
+  if (tx_free_ns <= now) {
+    return SERIAL_TX_BUFFER_SIZE - 1;
+  }
+  uint64_t queued = (tx_free_ns - now + byte_ns() - 1) / byte_ns();
+  if (queued >= SERIAL_TX_BUFFER_SIZE - 1) {
+    return 0;
+  }
+  return SERIAL_TX_BUFFER_SIZE - 1 - queued;
+}
+
+void HardwareSerial::flush() {
+  uint64_t now = sim::now_us() * 1000;
+  if (tx_free_ns > now) {
+    uint64_t wait = (tx_free_ns - now + 999) / 1000;
+    tx_blocked_us += wait;
+    sim::advance_us(wait);
+  }
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+
+  // Buffer full: block until the UART has shifted out a byte
+  if (availableForWrite() == 0) {
+    uint64_t now = sim::now_us() * 1000;
+    uint64_t room_at = tx_free_ns - (SERIAL_TX_BUFFER_SIZE - 2) * byte_ns();
+    uint64_t wait = (room_at - now + 999) / 1000;
+    tx_blocked_us += wait;
+    sim::advance_us(wait);
+  }
+
+  uint64_t now = sim::now_us() * 1000;
+  if (tx_free_ns < now) {
+    tx_free_ns = now;
+  }
+  tx_free_ns += byte_ns();
+
+  output.push_back((char)c);
+  return 1;
+}
+
+void HardwareSerial::send(const uint8_t *data, size_t size) {
+  uint64_t now = sim::now_us() * 1000;
+  if (line_free_ns < now) {
+    line_free_ns = now;
+  }
+
+  for (size_t i = 0; i < size; i++) {
+    if (line_count == SIM_LINE_QUEUE_SIZE) {
+      line_overflows++;
+      continue;
+    }
+    line_free_ns += byte_ns();
+    Arrival a = { (line_free_ns + 999) / 1000, data[i] };
+    line[(line_head + line_count) % SIM_LINE_QUEUE_SIZE] = a;
+    line_count++;
+  }
+}
+
+void HardwareSerial::send(const char *str) {
+  send((const uint8_t *)str, strlen(str));
+}
+
+void HardwareSerial::arrive(const uint8_t *data, size_t size) {
+  receive();
+  for (size_t i = 0; i < size; i++) {
+    if (rx_count < SERIAL_RX_BUFFER_SIZE) {
+      rx[(rx_head + rx_count) % SERIAL_RX_BUFFER_SIZE] = data[i];
+      rx_count++;
+    } else {
+      rx_overflows++;
+    }
+  }
+}
@@ -0,0 +1,93 @@
+/*
+ * HardwareSerial.h
+ *
+ * Host stand-in for the ATmega2560 UARTs. Each port models the AVR core's
+ * 64-byte RX and TX ring buffers at the configured baud rate:
+ *
+ *  - Bytes sent *to* the firmware with send() arrive one at a time at line
+ *    rate. Bytes that arrive while the RX buffer is full are dropped, just
+ *    like on the board.
+ *  - Bytes written *by* the firmware drain at line rate. Writing into a full
+ *    TX buffer blocks, which advances the virtual clock until there is room.
+ */
+
+#ifndef HardwareSerial_h
+#define HardwareSerial_h
+
+#include <string>
+
+#include "Stream.h"
+
+#define SERIAL_RX_BUFFER_SIZE 64
+#define SERIAL_TX_BUFFER_SIZE 64
+
+// How many bytes can be queued with send() before they arrive
+#define SIM_LINE_QUEUE_SIZE 4096
+
+class HardwareSerial : public Stream {
+  struct Arrival {
+    uint64_t at_us;
+    uint8_t value;
+  };
+
+  unsigned long baud;
+
+  // Bytes on their way down the wire, and the bytes received but not read yet.
+  // Both are fixed rings, so running the firmware never allocates on the host either.
+  Arrival line[SIM_LINE_QUEUE_SIZE];
+  unsigned int line_head, line_count;
+  uint8_t rx[SERIAL_RX_BUFFER_SIZE];
+  unsigned int rx_head, rx_count;
+  uint64_t line_free_ns;
+
+  uint64_t tx_free_ns;
+
+  uint64_t byte_ns();
+  void receive();
+
+public:
+  HardwareSerial();
+
+  // Arduino API
+  void begin(unsigned long baud_rate);
+  void end();
+  int available();
+  int peek();
+  int read();
+  int availableForWrite();
+  void flush();
+  size_t write(uint8_t);
+  using Print::write;
+
+  // Simulation API
+
+  // Queue bytes to arrive on RX at line rate, starting now (or after anything still queued)
+  void send(const uint8_t *data, size_t size);
+  void send(const char *str);
+
+  // Put bytes straight into the RX buffer, as if they had already come down the line
+  // (for replaying bytes recorded on the board at the time they were read)
+  void arrive(const uint8_t *data, size_t size);
+
+  // Drop everything queued, buffered and captured
+  void reset();
+
+  // Everything the firmware has written to this port
+  std::string output;
+
+  // Number of RX bytes lost because the buffer was full
+  unsigned long rx_overflows;
+
+  // Number of bytes send() couldn't queue
+  unsigned long line_overflows;
+
+  // Total virtual time the firmware spent blocked on a full TX buffer
+  uint64_t tx_blocked_us;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+extern HardwareSerial Serial3;
+
+#endif /* HardwareSerial_h */
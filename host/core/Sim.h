@@ -0,0 +1,49 @@
+/*
+ * Sim.h
+ *
+ * Control side of the host Arduino stand-in. The firmware only sees the
+ * normal Arduino API; drivers, tests and benchmarks use these functions to
+ * move the virtual clock, feed the serial ports and inspect the outputs.
+ */
+
+#ifndef Sim_h
+#define Sim_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace sim {
+
+  // Called for every write to a pin's output (analogWrite(), or an OCRnx register of a 16-bit
+  // timer, see avr/io.h) with the virtual time it happened at and the duty cycle, 0 - 65535
+  typedef void (*pwm_listener)(uint64_t at_us, uint8_t pin, int duty);
+
+  // Put the board back to power-on state: clock at 0, outputs low,
+  // serial ports empty and EEPROM erased (0xFF)
+  void reset();
+
+  // Virtual clock
+  uint64_t now_us();
+  void advance_us(uint64_t us);
+  void advance_ms(unsigned long ms);
+
+  // Duty cycle of a pin's output, 0 - 65535 (analogWrite(v) is v * 257)
+  int pwm(uint8_t pin);
+
+  // Number of analogWrite() calls on one pin, or on all pins
+  unsigned long pwm_writes(uint8_t pin);
+  unsigned long pwm_writes();
+
+  // Get told about every analogWrite() (pass NULL to stop)
+  void on_pwm(pwm_listener listener);
+
+  // Value returned by analogRead() on a pin
+  void set_analog(uint8_t pin, int value);
+
+  // The in-memory EEPROM and how many byte writes it has seen
+  uint8_t *eeprom();
+  size_t eeprom_size();
+  unsigned long eeprom_writes();
+}
+
+#endif /* Sim_h */
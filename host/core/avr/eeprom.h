@@ -0,0 +1,22 @@
+/*
+ * avr/eeprom.h
+ *
+ * Host stand-in: EEPROM addresses index into an in-memory array that the
+ * simulation can inspect and preload (see Sim.h).
+ */
+
+#ifndef EEPROM_H_
+#define EEPROM_H_
+
+#include <stdint.h>
+
+// ATmega2560 EEPROM size
+#define E2END 0xFFF
+
+uint8_t eeprom_read_byte(const uint8_t *addr);
+void eeprom_write_byte(uint8_t *addr, uint8_t value);
+
+// True when no write is in progress, so the next read or write won't have to wait
+uint8_t eeprom_is_ready(void);
+
+#endif /* EEPROM_H_ */
@@ -0,0 +1,73 @@
+/*
+ * avr/io.h
+ *
+ * Host stand-in: the registers of the ATmega2560's 16-bit timers (1, 3, 4
+ * and 5) that the PWM output code uses. TCCRnx and ICRn are plain
+ * variables. Writing an OCRnx changes the duty cycle of its pin (see
+ * Sim.h), when the pin is connected to the timer by its COM bit in TCCRnA;
+ * the duty cycle is (OCRnx + 1) / (ICRn + 1), as in fast PWM.
+ */
+
+#ifndef AVR_IO_H_
+#define AVR_IO_H_
+
+#include <stdint.h>
+
+#ifndef _BV
+#define _BV(bit) (1 << (bit))
+#endif
+
+// Output compare register of one timer channel, and the pin it drives
+struct SimOCR {
+  uint8_t pin;
+  volatile uint8_t &tccra;
+  volatile uint16_t &icr;
+  uint8_t com;
+  uint16_t value;
+
+  SimOCR(uint8_t p, volatile uint8_t &a, volatile uint16_t &top, uint8_t c)
+    : pin(p), tccra(a), icr(top), com(c), value(0) {}
+  SimOCR &operator=(uint16_t v);
+  operator uint16_t() const { return value; }
+};
+
+#define SIM_TIMER(n) \
+  extern volatile uint8_t TCCR##n##A; \
+  extern volatile uint8_t TCCR##n##B; \
+  extern volatile uint16_t ICR##n; \
+  extern SimOCR OCR##n##A; \
+  extern SimOCR OCR##n##B; \
+  extern SimOCR OCR##n##C;
+
+SIM_TIMER(1)
+SIM_TIMER(3)
+SIM_TIMER(4)
+SIM_TIMER(5)
+
+// TCCRnA
+#define COM1A1 7
+#define COM1A0 6
+#define COM1B1 5
+#define COM1B0 4
+#define COM1C1 3
+#define COM1C0 2
+#define WGM11 1
+#define WGM10 0
+#define COM3A1 7
+#define COM3B1 5
+#define COM3C1 3
+#define COM4A1 7
+#define COM4B1 5
+#define COM4C1 3
+#define COM5A1 7
+#define COM5B1 5
+#define COM5C1 3
+
+// TCCRnB
+#define WGM13 4
+#define WGM12 3
+#define CS12 2
+#define CS11 1
+#define CS10 0
+
+#endif /* AVR_IO_H_ */
@@ -0,0 +1,27 @@
+/*
+ * avr/pgmspace.h
+ *
+ * Host stand-in: there is only one address space, so program memory reads
+ * are plain dereferences.
+ */
+
+#ifndef PGMSPACE_H_
+#define PGMSPACE_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+#define pgm_read_ptr(addr) (*(void * const *)(addr))
+
+#define strlen_P strlen
+#define memcpy_P memcpy
+#define strcmp_P strcmp
+
+#endif /* PGMSPACE_H_ */
@@ -0,0 +1,33 @@
+/*
+ * util/crc16.h
+ *
+ * Host stand-in for the avr-libc CRC helpers, using the C equivalents
+ * given in the avr-libc documentation.
+ */
+
+#ifndef CRC16_H_
+#define CRC16_H_
+
+#include <stdint.h>
+
+// CRC-CCITT (polynomial 0x1021, start with 0xFFFF)
+static inline uint16_t _crc_ccitt_update(uint16_t crc, uint8_t data) {
+  data ^= (uint8_t)(crc & 0xFF);
+  data ^= data << 4;
+  return ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4) ^ ((uint16_t)data << 3));
+}
+
+// CRC-16 (polynomial 0xA001, start with 0xFFFF)
+static inline uint16_t _crc16_update(uint16_t crc, uint8_t a) {
+  crc ^= a;
+  for (int i = 0; i < 8; ++i) {
+    if (crc & 1) {
+      crc = (crc >> 1) ^ 0xA001;
+    } else {
+      crc = (crc >> 1);
+    }
+  }
+  return crc;
+}
+
+#endif /* CRC16_H_ */
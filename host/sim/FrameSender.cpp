@@ -0,0 +1,59 @@
+/*
+ * FrameSender.cpp
+ *
+ * Encodes frames for the stream program. See FrameSender.h
+ */
+
+#include "Arduino.h"
+#include "HSV.h"
+#include "FrameStream.h"
+#include "FrameSender.h"
+
+static size_t encode(const uint8_t *payload, uint8_t length, uint8_t *out) {
+  StreamCheck check;
+  check.reset();
+
+  size_t n = 0;
+  out[n++] = STREAM_START1;
+  out[n++] = STREAM_START2;
+  out[n++] = length;
+  check.add(length);
+  for (uint8_t i = 0; i < length; i++) {
+    out[n++] = payload[i];
+    check.add(payload[i]);
+  }
+  out[n++] = check.sum1;
+  out[n++] = check.sum2;
+  return n;
+}
+
+size_t encode_frame(const uint8_t *values, uint16_t fade_ms, uint8_t *out) {
+  uint8_t payload[STREAM_VALUES + 2];
+  memcpy(payload, values, STREAM_VALUES);
+  if (!fade_ms) {
+    return encode(payload, STREAM_VALUES, out);
+  }
+  payload[STREAM_VALUES] = fade_ms & 0xFF;
+  payload[STREAM_VALUES + 1] = fade_ms >> 8;
+  return encode(payload, STREAM_VALUES + 2, out);
+}
+
+size_t encode_stop(uint8_t *out) {
+  return encode(NULL, 0, out);
+}
+
+void pattern_frame(unsigned long n, unsigned int fps, uint8_t *values) {
+  unsigned long ms = n * 1000 / fps;
+  bool beat = ms % 500 < 1000 / fps;
+
+  for (uint8_t shelf = 0; shelf < STREAM_VALUES / 3; shelf++) {
+    uint8_t *rgb = values + shelf * 3;
+    if (beat) {
+      memset(rgb, 255, 3);
+      continue;
+    }
+    uint16_t hue = ((ms % 1000) * HUE_RANGE / 1000 + shelf * HUE_RANGE / 4) % HUE_RANGE;
+    HSV color = { hue, 255, 255 };
+    hsv_to_rgb(color, rgb);
+  }
+}
@@ -0,0 +1,29 @@
+/*
+ * FrameSender.h
+ *
+ * Encodes frames for the stream program the way a PC sends them (the format
+ * is in FrameStream.h), and makes a test pattern to send. Shared by
+ * bookshelf_sim's --stream and the stream_send tool.
+ */
+
+#ifndef FrameSender_h
+#define FrameSender_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Longest encoded frame
+#define FRAME_SENDER_MAX 32
+
+// Encode a frame of STREAM_VALUES values, faded to over fade_ms (0 to set them).
+// Returns its length.
+size_t encode_frame(const uint8_t *values, uint16_t fade_ms, uint8_t *out);
+
+// Encode the frame that ends streaming. Returns its length.
+size_t encode_stop(uint8_t *out);
+
+// Frame n of the test pattern at fps frames a second: a rainbow climbing the shelves, a
+// second a turn, with a white flash on every beat at 120 bpm
+void pattern_frame(unsigned long n, unsigned int fps, uint8_t *values);
+
+#endif /* FrameSender_h */
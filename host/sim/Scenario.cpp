@@ -0,0 +1,215 @@
+/*
+ * Scenario.cpp
+ *
+ * Drives the firmware on the host.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+
+#include "Arduino.h"
+#include "Sim.h"
+#include "Scenario.h"
+#include "Trace.h"
+
+static uint64_t host_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+Scenario::Scenario() {
+  next_event = 0;
+  distance = 0;
+  next_frame_ms = 0;
+  loop_us = 100;
+  sonar_period_ms = 150;
+  loops = 0;
+  time_loops = true;
+  loop_ns_total = 0;
+  loop_ns_max = 0;
+  loop_virtual_us_max = 0;
+}
+
+void Scenario::ir(unsigned long at_ms, char code) {
+  Event e = { at_ms, code, -1, "", NULL };
+  events.push_back(e);
+}
+
+void Scenario::range(unsigned long at_ms, int mm) {
+  Event e = { at_ms, 0, mm, "", NULL };
+  events.push_back(e);
+}
+
+void Scenario::console(unsigned long at_ms, const char *line) {
+  Event e = { at_ms, 0, -1, std::string(line) + "\n", NULL };
+  events.push_back(e);
+}
+
+void Scenario::serial(unsigned long at_ms, const uint8_t *data, size_t size) {
+  Event e = { at_ms, 0, -1, std::string((const char *)data, size), NULL };
+  events.push_back(e);
+}
+
+long Scenario::range_trace(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (!f) return -1;
+
+  long readings = 0;
+  char line[128];
+  while (fgets(line, sizeof(line), f)) {
+    unsigned long at_ms;
+    int mm;
+    if (line[0] == '#') continue;
+    if (sscanf(line, "%lu %d", &at_ms, &mm) == 2) {
+      range(at_ms, mm);
+      readings++;
+    }
+  }
+  fclose(f);
+  return readings;
+}
+
+// Turn the hex of each "trace ..." line of a serial log back into bytes
+static std::string trace_from_log(const std::string &log) {
+  std::string trace;
+  size_t at = 0;
+  while (at < log.size()) {
+    size_t end = log.find('\n', at);
+    if (end == std::string::npos) end = log.size();
+
+    if (!log.compare(at, 6, "trace ")) {
+      for (size_t i = at + 6; i + 1 < end && isxdigit(log[i]) && isxdigit(log[i + 1]); i += 2) {
+        trace.push_back((char)strtoul(log.substr(i, 2).c_str(), NULL, 16));
+      }
+    }
+    at = end + 1;
+  }
+  return trace;
+}
+
+long Scenario::replay_trace(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f) return -1;
+
+  std::string trace;
+  char chunk[4096];
+  size_t got;
+  while ((got = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+    trace.append(chunk, got);
+  }
+  fclose(f);
+
+  const char magic[] = { 'B', 'B', 'T', TRACE_VERSION };
+  if (trace.compare(0, sizeof(magic), magic, sizeof(magic))) {
+    trace = trace_from_log(trace);
+    if (trace.compare(0, sizeof(magic), magic, sizeof(magic))) {
+      return -1;
+    }
+  }
+  if (trace.size() < TRACE_HEADER_SIZE) {
+    return -1;
+  }
+
+  const uint8_t *p = (const uint8_t *)trace.data();
+  unsigned long at_ms = p[4] | (unsigned long)p[5] << 8 | (unsigned long)p[6] << 16 |
+      (unsigned long)p[7] << 24;
+
+  // Bytes read from the same port in the same millisecond go in together
+  long bytes = 0;
+  for (size_t i = TRACE_HEADER_SIZE; i + 1 < trace.size(); i += 2) {
+    uint8_t source = p[i] >> 6;
+    if (source == TRACE_WAIT) {
+      at_ms += (p[i] & TRACE_SHORT_DELAY) << 8 | p[i + 1];
+      continue;
+    }
+    at_ms += p[i] & TRACE_SHORT_DELAY;
+
+    HardwareSerial *port = source == TRACE_IR ? &Serial1 : &Serial2;
+    if (!events.empty() && events.back().port == port && events.back().at_ms == at_ms) {
+      events.back().text.push_back(p[i + 1]);
+    } else {
+      Event e = { at_ms, 0, -1, std::string(1, p[i + 1]), port };
+      events.push_back(e);
+    }
+    bytes++;
+  }
+  return bytes;
+}
+
+unsigned long Scenario::end_ms() {
+  unsigned long end = 0;
+  for (size_t i = 0; i < events.size(); i++) {
+    end = std::max(end, events[i].at_ms);
+  }
+  return end;
+}
+
+void Scenario::start() {
+  std::stable_sort(events.begin(), events.end(), [](const Event &a, const Event &b) {
+    return a.at_ms < b.at_ms;
+  });
+  next_event = 0;
+  distance = 0;
+  next_frame_ms = 0;
+
+  sim::reset();
+#if TRACE
+  // The clock starts over, so the trace has to as well
+  tracer.clear();
+#endif
+  setup();
+}
+
+// Hand the firmware everything that is due by now
+void Scenario::deliver(unsigned long now_ms) {
+  while (next_event < events.size() && events[next_event].at_ms <= now_ms) {
+    const Event &e = events[next_event++];
+    if (e.port) {
+      e.port->arrive((const uint8_t *)e.text.data(), e.text.size());
+    } else if (e.ir) {
+      Serial1.send((const uint8_t *)&e.ir, 1);
+    } else if (!e.text.empty()) {
+      Serial.send((const uint8_t *)e.text.data(), e.text.size());
+    } else {
+      distance = e.distance;
+    }
+  }
+
+  if (distance > 0 && now_ms >= next_frame_ms) {
+    char frame[8];
+    snprintf(frame, sizeof(frame), "R%04d\r", constrain(distance, 0, 9999));
+    Serial2.send(frame);
+    next_frame_ms = now_ms + sonar_period_ms;
+  }
+}
+
+void Scenario::run_until(unsigned long ms) {
+  while (millis() < ms) {
+    deliver(millis());
+
+    uint64_t virtual_start = sim::now_us();
+    loops++;
+    if (time_loops) {
+      uint64_t start = host_ns();
+      loop();
+      uint64_t elapsed = host_ns() - start;
+
+      loop_ns_total += elapsed;
+      if (elapsed > loop_ns_max) {
+        loop_ns_max = elapsed;
+      }
+    } else {
+      loop();
+    }
+
+    sim::advance_us(loop_us);
+    uint64_t virtual_elapsed = sim::now_us() - virtual_start;
+    if (virtual_elapsed > loop_virtual_us_max) {
+      loop_virtual_us_max = virtual_elapsed;
+    }
+  }
+}
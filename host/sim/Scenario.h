@@ -0,0 +1,90 @@
+/*
+ * Scenario.h
+ *
+ * Drives the firmware on the host: runs setup() and then loop() against the
+ * virtual clock, delivering scripted IR remote codes on Serial1, MaxSonar
+ * range frames on Serial2 and console commands on Serial as time passes,
+ * or the IR and sonar bytes of a trace recorded on the board (see Trace.h).
+ */
+
+#ifndef Scenario_h
+#define Scenario_h
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class HardwareSerial;
+
+class Scenario {
+  struct Event {
+    unsigned long at_ms;
+    char ir;
+    int distance;
+    std::string text;
+    HardwareSerial *port;  // Set for recorded bytes, which are put straight in its RX buffer
+  };
+
+  std::vector<Event> events;
+  size_t next_event;
+  int distance;
+  unsigned long next_frame_ms;
+
+  void deliver(unsigned long now_ms);
+
+public:
+  Scenario();
+
+  // Virtual time each loop() iteration takes (default 100us)
+  unsigned long loop_us;
+
+  // How often the sonar sends a range frame (default 150ms, ~6Hz)
+  unsigned long sonar_period_ms;
+
+  // Send an IR code from the remote at a point in time
+  void ir(unsigned long at_ms, char code);
+
+  // Type a line (a newline is added) on the USB serial console at a point in time
+  void console(unsigned long at_ms, const char *line);
+
+  // Send bytes on the USB serial port at a point in time
+  void serial(unsigned long at_ms, const uint8_t *data, size_t size);
+
+  // From this point in time on, the sonar reports this distance in mm (0 = no frames)
+  void range(unsigned long at_ms, int mm);
+
+  // Load a sonar trace: one "<ms> <mm>" reading per line, '#' starts a comment.
+  // Returns the number of readings, or -1 if the file can't be read.
+  long range_trace(const char *path);
+
+  // Load an input trace recorded on the board: the binary format in Trace.h, or a serial log
+  // with the "trace" command's output in it. Each byte is handed to the firmware at the
+  // millisecond it was read on the board. Returns the number of bytes, or -1 if the file
+  // can't be read or has no trace in it.
+  long replay_trace(const char *path);
+
+  // When the last event happens
+  unsigned long end_ms();
+
+  // Reset the board and run setup()
+  void start();
+
+  // Run loop() until the virtual clock reaches this time
+  void run_until(unsigned long ms);
+
+  // Number of loop() iterations run so far
+  unsigned long loops;
+
+  // Whether to time each loop() (default true). Benchmarks timing a whole run turn it off,
+  // since reading the host clock twice costs about as much as a loop() does.
+  bool time_loops;
+
+  // Host time spent inside loop(), in nanoseconds
+  uint64_t loop_ns_total;
+  uint64_t loop_ns_max;
+
+  // Longest stretch of virtual time a single loop() took, including delay() and blocking writes
+  uint64_t loop_virtual_us_max;
+};
+
+#endif /* Scenario_h */
@@ -0,0 +1,179 @@
+/*
+ * main.cpp
+ *
+ * bookshelf_sim: run the firmware on the host against a scripted remote and
+ * sonar, faster than real time.
+ *
+ *   bookshelf_sim [options]
+ *
+ *   --ms N           Virtual time to run for, in milliseconds (default 10000, or a
+ *                    second past the end of a --replay trace)
+ *   --loop-us N      Virtual time each loop() takes, in microseconds (default 100)
+ *   --ir MS:CODE     Press a remote button (P, A, B, C, u, d, l, r, s) at MS
+ *   --range MS:MM    From MS on, the sonar reports MM millimeters (0 = silent)
+ *   --trace FILE     Replay a sonar trace (like the ones in tests/data)
+ *   --replay FILE    Replay the IR and sonar input recorded on the board (see Trace.h),
+ *                    from the binary trace or a serial log with "trace" output in it
+ *   --console MS:LINE  Type a command on the USB serial console at MS (e.g. "5000:get")
+ *   --stream MS:FPS  From MS, stream the test pattern to the stream program at FPS frames a
+ *                    second (see FrameSender.h), and stop half a second before the end
+ *   --pwm-log        Print every PWM change as "<ms> <pin> <duty>", duty 0 - 65535
+ *   --serial         Echo what the firmware prints on Serial to stderr
+ *
+ * --replay with --pwm-log gives the PWM timeline of a run on the wall, to
+ * diff against another build's.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Arduino.h"
+#include "Sim.h"
+#include "Scenario.h"
+#include "FrameSender.h"
+#include "BoozeBookshelf.h"
+
+static int last_pwm[NUM_DIGITAL_PINS];
+
+static void log_pwm(uint64_t at_us, uint8_t pin, int duty) {
+  if (last_pwm[pin] == duty) return;
+  last_pwm[pin] = duty;
+  printf("%llu.%03llu %u %d\n",
+      (unsigned long long)(at_us / 1000), (unsigned long long)(at_us % 1000), pin, duty);
+}
+
+static void usage() {
+  fprintf(stderr,
+      "usage: bookshelf_sim [--ms N] [--loop-us N] [--ir MS:CODE]... [--range MS:MM]...\n"
+      "                     [--trace FILE] [--replay FILE] [--console MS:LINE]...\n"
+      "                     [--stream MS:FPS] [--pwm-log] [--serial]\n");
+  exit(2);
+}
+
+static double wall_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+int main(int argc, char **argv) {
+  Scenario scenario;
+  unsigned long run_ms = 0;
+  bool pwm_log = false;
+  bool echo_serial = false;
+  bool replay = false;
+  unsigned long stream_ms = 0;
+  unsigned int stream_fps = 0;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+    if (!strcmp(arg, "--ms") && val) {
+      run_ms = strtoul(val, NULL, 10);
+      i++;
+    } else if (!strcmp(arg, "--loop-us") && val) {
+      scenario.loop_us = strtoul(val, NULL, 10);
+      i++;
+    } else if (!strcmp(arg, "--ir") && val && strchr(val, ':')) {
+      scenario.ir(strtoul(val, NULL, 10), strchr(val, ':')[1]);
+      i++;
+    } else if (!strcmp(arg, "--range") && val && strchr(val, ':')) {
+      scenario.range(strtoul(val, NULL, 10), atoi(strchr(val, ':') + 1));
+      i++;
+    } else if (!strcmp(arg, "--trace") && val) {
+      if (scenario.range_trace(val) < 0) {
+        fprintf(stderr, "can't read %s\n", val);
+        exit(1);
+      }
+      i++;
+    } else if (!strcmp(arg, "--replay") && val) {
+      if (scenario.replay_trace(val) < 0) {
+        fprintf(stderr, "no trace in %s\n", val);
+        exit(1);
+      }
+      replay = true;
+      i++;
+    } else if (!strcmp(arg, "--console") && val && strchr(val, ':')) {
+      scenario.console(strtoul(val, NULL, 10), strchr(val, ':') + 1);
+      i++;
+    } else if (!strcmp(arg, "--stream") && val && strchr(val, ':')) {
+      stream_ms = strtoul(val, NULL, 10);
+      stream_fps = atoi(strchr(val, ':') + 1);
+      if (!stream_fps) {
+        usage();
+      }
+      i++;
+    } else if (!strcmp(arg, "--pwm-log")) {
+      pwm_log = true;
+    } else if (!strcmp(arg, "--serial")) {
+      echo_serial = true;
+    } else {
+      usage();
+    }
+  }
+
+  if (!run_ms) {
+    run_ms = replay ? scenario.end_ms() + 1000 : 10000;
+  }
+
+  // Start the stream program, then send frames that fade for a frame and a half, so the next
+  // one comes in while the last is still fading
+  if (stream_fps) {
+    uint8_t values[STREAM_VALUES];
+    uint8_t frame[FRAME_SENDER_MAX];
+    unsigned long first_ms = stream_ms + 100, stop_ms = run_ms - 500;
+
+    scenario.console(stream_ms, "stream");
+    for (unsigned long n = 0; first_ms + n * 1000 / stream_fps < stop_ms; n++) {
+      pattern_frame(n, stream_fps, values);
+      size_t size = encode_frame(values, 1500 / stream_fps, frame);
+      scenario.serial(first_ms + n * 1000 / stream_fps, frame, size);
+    }
+    scenario.serial(stop_ms, frame, encode_stop(frame));
+  }
+
+  if (pwm_log) {
+    sim::on_pwm(log_pwm);
+  }
+
+  double start = wall_ms();
+  scenario.start();
+  scenario.run_until(run_ms);
+  double elapsed = wall_ms() - start;
+
+  if (echo_serial) {
+    fputs(Serial.output.c_str(), stderr);
+  }
+
+  // Summary
+  FILE *out = pwm_log ? stderr : stdout;
+  fprintf(out, "virtual_ms %lu\n", millis());
+  fprintf(out, "wall_ms %.1f\n", elapsed);
+  fprintf(out, "speedup %.0f\n", elapsed > 0 ? millis() / elapsed : 0);
+  fprintf(out, "loops %lu\n", scenario.loops);
+  fprintf(out, "loop_ns_avg %.0f\n", scenario.loops ? (double)scenario.loop_ns_total / scenario.loops : 0);
+  fprintf(out, "loop_ns_max %llu\n", (unsigned long long)scenario.loop_ns_max);
+  fprintf(out, "loop_virtual_us_max %llu\n", (unsigned long long)scenario.loop_virtual_us_max);
+  fprintf(out, "pwm_writes %lu\n", sim::pwm_writes());
+  fprintf(out, "pwm_writes_elided %lu\n", shelves.get_elided());
+  fprintf(out, "serial_tx_bytes %zu\n", Serial.output.size());
+  fprintf(out, "serial_tx_blocked_us %llu\n", (unsigned long long)Serial.tx_blocked_us);
+  fprintf(out, "serial2_rx_overflows %lu\n", Serial2.rx_overflows);
+  fprintf(out, "sonar_frames %lu\n", sonar.get_frames());
+  fprintf(out, "sonar_errors %lu\n", sonar.get_errors());
+  fprintf(out, "eeprom_writes %lu\n", sim::eeprom_writes());
+  fprintf(out, "stream_frames %lu\n", frame_stream.get_frames());
+  fprintf(out, "stream_bad %lu\n", frame_stream.get_bad());
+  fprintf(out, "stream_dropped %lu\n", frame_stream.get_dropped());
+  fprintf(out, "stream_late %lu\n", frame_stream.get_late());
+  fprintf(out, "pins");
+  for (uint8_t ch = 0; ch < SHELVES * RGB; ch++) {
+    fprintf(out, " %u=%d", shelves.get_pin(ch), sim::pwm(shelves.get_pin(ch)));
+  }
+  fprintf(out, "\n");
+
+  return 0;
+}
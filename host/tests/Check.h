@@ -0,0 +1,36 @@
+/*
+ * Check.h
+ *
+ * Minimal assertions for the host tests. A failed CHECK prints where it
+ * failed and makes the test exit with status 1.
+ */
+
+#ifndef Check_h
+#define Check_h
+
+#include <stdio.h>
+
+static int check_failures = 0;
+
+#define CHECK(cond) \
+  do { \
+    if (!(cond)) { \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      check_failures++; \
+    } \
+  } while (0)
+
+#define CHECK_EQ(a, b) \
+  do { \
+    long long check_a = (long long)(a), check_b = (long long)(b); \
+    if (check_a != check_b) { \
+      fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", \
+          __FILE__, __LINE__, #a, #b, check_a, check_b); \
+      check_failures++; \
+    } \
+  } while (0)
+
+// Return this from main()
+#define CHECK_RESULT() (check_failures ? 1 : 0)
+
+#endif /* Check_h */
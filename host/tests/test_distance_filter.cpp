@@ -0,0 +1,102 @@
+/*
+ * test_distance_filter.cpp
+ *
+ * Replay the sonar traces in tests/data through Program0, once with the
+ * readings used as they come (no filtering, no hysteresis, the way Program0
+ * used to work) and once with the distance filter and hysteresis, and count
+ * how many times the shelves' fade gets restarted.
+ *
+ * Noisy traces have to restart less with the filter. The clean trace has to
+ * restart exactly as often, and end up in the same state.
+ *
+ * Then hold a steady distance in follow mode, and check that once the shelves
+ * get there, retargeting them every loop() doesn't start (or finish) any fade.
+ */
+
+#include <string>
+
+#include "Arduino.h"
+#include "Sim.h"
+#include "Scenario.h"
+#include "BoozeBookshelf.h"
+#include "Check.h"
+
+#define TRACE_MS 30000
+
+struct Result {
+  int restarts;
+  int final_value;
+};
+
+static int count(const std::string &text, const char *what) {
+  int n = 0;
+  for (size_t at = text.find(what); at != std::string::npos; at = text.find(what, at + 1)) {
+    n++;
+  }
+  return n;
+}
+
+// Every Program0 fade logs one of these lines
+static int fade_restarts(const std::string &log) {
+  return count(log, "Close range") + count(log, "Medium range") + count(log, "Dim lights");
+}
+
+static Result replay(const char *trace, bool filtered) {
+  Scenario scenario;
+  CHECK(scenario.range_trace(trace) > 0);
+  scenario.start();
+
+  // After setup(), which loads the settings
+  if (filtered) {
+    distance_filter.configure(DISTANCE_MEDIAN, DISTANCE_SMOOTHING);
+    settings.hysteresis = RANGE_HYSTERESIS;
+  } else {
+    distance_filter.configure(1, 0);
+    settings.hysteresis = 0;
+  }
+  scenario.run_until(TRACE_MS);
+
+  Result r = { fade_restarts(Serial.output), shelves.get_value(0) };
+  return r;
+}
+
+static void follow_steady() {
+  Scenario scenario;
+  scenario.range(0, 1000);
+  scenario.ir(1000, IR_SELECT);
+  scenario.start();
+  scenario.run_until(5000);
+
+  int finished = 0;
+  for (unsigned long ms = 5001; ms <= 7000; ms++) {
+    scenario.run_until(ms);
+    if (shelves.finished() || shelves.fading()) {
+      finished++;
+    }
+  }
+  printf("follow mode at a steady distance: %d of 2000ms fading or finished\n", finished);
+  CHECK_EQ(finished, 0);
+  CHECK(shelves.get_value(0) > 0);
+}
+
+int main() {
+  const char *noisy[] = { "tests/data/linger_medium.trace", "tests/data/linger_close.trace" };
+  const char *clean = "tests/data/walk_up.trace";
+
+  for (unsigned i = 0; i < sizeof(noisy) / sizeof(noisy[0]); i++) {
+    Result raw = replay(noisy[i], false);
+    Result smooth = replay(noisy[i], true);
+    printf("%s: %d fade restarts unfiltered, %d filtered\n", noisy[i], raw.restarts, smooth.restarts);
+    CHECK(smooth.restarts < raw.restarts);
+  }
+
+  Result raw = replay(clean, false);
+  Result smooth = replay(clean, true);
+  printf("%s: %d fade restarts unfiltered, %d filtered\n", clean, raw.restarts, smooth.restarts);
+  CHECK_EQ(smooth.restarts, raw.restarts);
+  CHECK_EQ(smooth.final_value, raw.final_value);
+
+  follow_steady();
+
+  return CHECK_RESULT();
+}
@@ -0,0 +1,134 @@
+/*
+ * test_eeprom_store.cpp
+ *
+ * Check which record EEPROMStore loads from its ring of slots: the newest
+ * one whose CRC checks out, when the newest is torn by a power cut or
+ * corrupted, when the sequence numbers wrap around, and none at all from a
+ * freshly erased EEPROM, where the firmware starts with the default
+ * settings.
+ */
+
+#include <string.h>
+#include <util/crc16.h>
+
+#include "Arduino.h"
+#include "Sim.h"
+#include "Scenario.h"
+#include "BoozeBookshelf.h"
+#include "Check.h"
+
+#define BASE 0
+#define SLOTS 4
+#define DELAY_MS 10
+
+struct Record {
+  uint16_t value;
+  uint8_t tag;
+};
+
+typedef EEPROMStore<Record> Store;
+
+static int slot_address(uint8_t slot) {
+  return BASE + slot * Store::SLOT_SIZE;
+}
+
+// Save a record and poll until it's all written
+static void commit(Store &store, uint16_t value) {
+  Record r = { value, (uint8_t)value };
+  store.save(r);
+  for (int i = 0; i < 1000 && store.busy(); i++) {
+    sim::advance_ms(1);
+    store.poll(millis());
+  }
+  CHECK(!store.busy());
+}
+
+// What a store just powered up loads, or 0 if nothing
+static uint16_t load() {
+  Store store(BASE, SLOTS, DELAY_MS);
+  Record r;
+  return store.load(r) ? r.value : 0;
+}
+
+// Write a slot the way the store does: sequence, record, CRC
+static void write_slot(uint8_t slot, uint16_t seq, uint16_t value) {
+  uint8_t bytes[Store::SLOT_SIZE];
+  Record r;
+  memset(&r, 0, sizeof(r));
+  r.value = value;
+  r.tag = (uint8_t)value;
+  bytes[0] = seq & 0xFF;
+  bytes[1] = seq >> 8;
+  memcpy(bytes + 2, &r, sizeof(r));
+
+  uint16_t crc = 0xFFFF;
+  for (uint8_t i = 0; i < Store::SLOT_SIZE - 2; i++) {
+    crc = _crc_ccitt_update(crc, bytes[i]);
+  }
+  bytes[Store::SLOT_SIZE - 2] = crc & 0xFF;
+  bytes[Store::SLOT_SIZE - 1] = crc >> 8;
+  memcpy(sim::eeprom() + slot_address(slot), bytes, sizeof(bytes));
+}
+
+static void torn_and_corrupt() {
+  sim::reset();
+  Store store(BASE, SLOTS, DELAY_MS);
+  commit(store, 101);
+  commit(store, 102);
+  commit(store, 103);
+  CHECK_EQ(load(), 103);
+
+  // The power goes out a byte into the next write: still the last whole one
+  Record r = { 104, 104 };
+  store.save(r);
+  sim::advance_ms(DELAY_MS + 1);
+  store.poll(millis());
+  CHECK(store.busy());
+  CHECK_EQ(load(), 103);
+
+  // The newest whole slot goes bad: back to the one before
+  sim::eeprom()[slot_address(2) + 2] ^= 0x01;
+  CHECK_EQ(load(), 102);
+}
+
+static void sequence_wrap() {
+  sim::reset();
+
+  // Newest is slot 2, the sequence numbers having gone past 0xFFFF since slot 3
+  write_slot(3, 0xFFFE, 201);
+  write_slot(0, 0xFFFF, 202);
+  write_slot(1, 0x0000, 203);
+  write_slot(2, 0x0001, 204);
+  CHECK_EQ(load(), 204);
+
+  // And the next write goes after it, over the oldest
+  Store store(BASE, SLOTS, DELAY_MS);
+  commit(store, 205);
+  CHECK_EQ(load(), 205);
+  CHECK_EQ(sim::eeprom()[slot_address(3)], 0x02);
+}
+
+static void erased() {
+  sim::reset();
+  for (int i = 0; i < SLOTS * Store::SLOT_SIZE; i++) {
+    CHECK_EQ(sim::eeprom()[BASE + i], 0xFF);
+  }
+  CHECK_EQ(load(), 0);
+
+  // The firmware starts with the defaults, whatever it had before
+  settings.close_range = 1;
+  settings.program = 2;
+  Scenario scenario;
+  scenario.start();
+  CHECK_EQ(settings.close_range, CLOSE_RANGE);
+  CHECK_EQ(settings.med_range, MED_RANGE);
+  CHECK_EQ(settings.fade_speed, FADE_SPEED);
+  CHECK_EQ(settings.program, 0);
+}
+
+int main() {
+  torn_and_corrupt();
+  sequence_wrap();
+  erased();
+  return CHECK_RESULT();
+}
@@ -0,0 +1,87 @@
+/*
+ * test_program_switch.cpp
+ *
+ * Switch programs with the remote 100,000 times and check that the firmware
+ * never allocates: no operator new calls, and the heap's size and usage are
+ * the same at the end as at the start.
+ */
+
+#include <malloc.h>
+#include <stdlib.h>
+#include <new>
+
+#include "Arduino.h"
+#include "Sim.h"
+#include "BoozeBookshelf.h"
+#include "Check.h"
+
+#define SWITCHES 100000L
+
+static unsigned long allocations = 0;
+
+void *operator new(size_t size) {
+  allocations++;
+  void *p = malloc(size);
+  if (!p) abort();
+  return p;
+}
+
+void *operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+  free(p);
+}
+
+void operator delete[](void *p) noexcept {
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+  free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+  free(p);
+}
+
+int main() {
+  const char codes[] = { IR_A, IR_B, IR_C, IR_POWER };
+  const byte programs[] = { 1, 2, 3, 0 };
+
+  sim::reset();
+  setup();
+  CHECK_EQ(current_program_num, 0);
+
+  // Keep the captured serial output from growing while we watch the heap
+  Serial.output.reserve(1 << 16);
+
+  unsigned long allocations_before = allocations;
+  struct mallinfo2 before = mallinfo2();
+
+  for (long i = 0; i < SWITCHES; i++) {
+    char code = codes[i % 4];
+    Serial1.send((const uint8_t *)&code, 1);
+    sim::advance_us(100);
+    loop();
+
+    if (current_program_num != programs[i % 4]) {
+      CHECK_EQ(current_program_num, programs[i % 4]);
+      break;
+    }
+    if (Serial.output.size() > (1 << 15)) {
+      Serial.output.clear();
+    }
+  }
+
+  struct mallinfo2 after = mallinfo2();
+
+  CHECK_EQ(allocations - allocations_before, 0);
+  CHECK_EQ(after.uordblks, before.uordblks);
+  CHECK_EQ(after.arena, before.arena);
+
+  printf("%ld program switches, %lu allocations, heap %zu bytes in use (was %zu)\n",
+      SWITCHES, allocations - allocations_before, after.uordblks, before.uordblks);
+  return CHECK_RESULT();
+}
@@ -0,0 +1,114 @@
+/*
+ * test_stream.cpp
+ *
+ * Stream frames to the stream program the way a PC does, at 60 frames a
+ * second through the USB serial port at line rate, with a corrupted frame in
+ * the middle, and check every good frame is shown and the bad one counted.
+ * Then feed the decoder frames faster than they're taken, and slower than
+ * they fade, to check the dropped and late counts.
+ */
+
+#include <string.h>
+
+#include "Arduino.h"
+#include "Sim.h"
+#include "Scenario.h"
+#include "FrameSender.h"
+#include "BoozeBookshelf.h"
+#include "Check.h"
+
+#define FPS 60
+#define STREAM_START_MS 2000
+#define FIRST_FRAME_MS 2100
+#define FRAMES 180
+
+static void stream_program() {
+  Scenario scenario;
+  uint8_t values[STREAM_VALUES];
+  uint8_t frame[FRAME_SENDER_MAX];
+
+  scenario.ir(1000, IR_B);
+  scenario.console(STREAM_START_MS, "stream");
+
+  // Frames that fade for a frame and a half, so each arrives before the last one is done
+  unsigned long at_ms = FIRST_FRAME_MS;
+  for (int n = 0; n < FRAMES; n++) {
+    at_ms = FIRST_FRAME_MS + n * 1000L / FPS;
+    pattern_frame(n, FPS, values);
+    size_t size = encode_frame(values, 1500 / FPS, frame);
+    if (n == FRAMES / 2) {
+      frame[5] ^= 0x10;
+    }
+    scenario.serial(at_ms, frame, size);
+  }
+
+  // Then one that sets the shelves straight to a color
+  const uint8_t last[STREAM_VALUES] = { 10, 20, 30, 40, 50, 60, 70, 80, 90, 100, 110, 120 };
+  scenario.serial(at_ms + 100, frame, encode_frame(last, 0, frame));
+  scenario.serial(at_ms + 1000, frame, encode_stop(frame));
+
+  scenario.start();
+  scenario.run_until(STREAM_START_MS + 50);
+  CHECK_EQ(current_program_num, PROGRAM_STREAM);
+
+  scenario.run_until(at_ms + 500);
+  CHECK_EQ(current_program_num, PROGRAM_STREAM);
+  for (byte ch = 0; ch < STREAM_VALUES; ch++) {
+    CHECK_EQ(shelves.get_value(ch), last[ch]);
+  }
+
+  printf("%lu frames, %lu bad, %lu dropped, %lu late\n", frame_stream.get_frames(),
+      frame_stream.get_bad(), frame_stream.get_dropped(), frame_stream.get_late());
+  CHECK_EQ(frame_stream.get_frames(), FRAMES);
+  CHECK_EQ(frame_stream.get_bad(), 1);
+  CHECK_EQ(frame_stream.get_dropped(), 0);
+  // Late: the frame after the bad one, which came two frames after the one before, and the
+  // last one, which came well after the fades had ended
+  CHECK_EQ(frame_stream.get_late(), 2);
+
+  // The stop frame goes back to program 2, which streaming didn't replace as the one to start in
+  scenario.run_until(at_ms + 1100);
+  CHECK_EQ(current_program_num, 2);
+  CHECK_EQ(settings.program, 2);
+}
+
+static void dropped_and_late() {
+  FrameStream stream(Serial3);
+  uint8_t values[STREAM_VALUES];
+  uint8_t frame[FRAME_SENDER_MAX];
+  size_t size;
+
+  // Two frames in before the first is taken: the first is dropped, the second shown
+  memset(values, 1, sizeof(values));
+  size = encode_frame(values, 10, frame);
+  Serial3.arrive(frame, size);
+  memset(values, 2, sizeof(values));
+  size = encode_frame(values, 10, frame);
+  Serial3.arrive(frame, size);
+
+  CHECK(stream.poll());
+  CHECK_EQ(stream.take(1000).values[0], 2);
+  CHECK_EQ(stream.get_dropped(), 1);
+
+  // Taken before the last one's 10ms fade is over, then after it
+  Serial3.arrive(frame, size);
+  CHECK(stream.poll());
+  stream.take(1008);
+  CHECK_EQ(stream.get_late(), 0);
+
+  Serial3.arrive(frame, size);
+  CHECK(stream.poll());
+  stream.take(1030);
+  CHECK_EQ(stream.get_late(), 1);
+  CHECK_EQ(stream.get_frames(), 3);
+
+  // Nothing new: nothing to take
+  CHECK(!stream.poll());
+  CHECK_EQ(stream.get_bad(), 0);
+}
+
+int main() {
+  stream_program();
+  dropped_and_late();
+  return CHECK_RESULT();
+}
@@ -0,0 +1,155 @@
+/*
+ * test_trace.cpp
+ *
+ * Record a run's IR and sonar input the way the board does (built with
+ * TRACE=1), print it with the console's "trace" command, and check the
+ * bytes and the milliseconds they were read at. Then replay the printed log
+ * in a fresh run and check it records the very same trace.
+ *
+ * Last, leave the clock for longer than the ring can hold in waits and
+ * check the trace starts over instead of filling up with them.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "Sim.h"
+#include "Scenario.h"
+#include "BoozeBookshelf.h"
+#include "Check.h"
+
+#define RANGE_MM 700
+#define RANGE_END_MS 4500
+#define TRACE_MS 5000
+#define END_MS 7000
+
+// The "trace" lines in a serial log, with the header and summary, from the first one on
+static std::string trace_lines(const std::string &log) {
+  size_t at = log.find("trace ");
+  size_t end = log.find("dropped", at);
+  if (at == std::string::npos || end == std::string::npos) {
+    return "";
+  }
+  return log.substr(at, end - at);
+}
+
+// The bytes of the printed trace
+static std::string trace_bytes(const std::string &lines) {
+  std::string bytes;
+  for (size_t at = lines.find("trace "); at != std::string::npos; at = lines.find("trace ", at)) {
+    at += 6;
+    while (at + 1 < lines.size() && isxdigit(lines[at]) && isxdigit(lines[at + 1])) {
+      bytes.push_back((char)strtol(lines.substr(at, 2).c_str(), NULL, 16));
+      at += 2;
+    }
+  }
+  return bytes;
+}
+
+static std::string record() {
+  Scenario scenario;
+  scenario.range(0, RANGE_MM);
+  scenario.range(RANGE_END_MS, 0);
+  scenario.ir(2000, IR_SELECT);
+  scenario.ir(3000, IR_SELECT);
+  scenario.console(TRACE_MS, "trace");
+  scenario.start();
+  scenario.run_until(END_MS);
+  return trace_lines(Serial.output);
+}
+
+static void check_recording(const std::string &lines) {
+  std::string trace = trace_bytes(lines);
+  CHECK(trace.size() > TRACE_HEADER_SIZE);
+  CHECK(!trace.compare(0, 4, "BBT\x01"));
+
+  // Walk the events, keeping the time each byte was read at
+  unsigned long at_ms = (uint8_t)trace[4] | (uint8_t)trace[5] << 8 |
+      (unsigned long)(uint8_t)trace[6] << 16 | (unsigned long)(uint8_t)trace[7] << 24;
+  std::string ir, sonar;
+  unsigned long ir_ms[2] = { 0, 0 };
+  unsigned long first_sonar_ms = 0, last_sonar_ms = 0;
+  for (size_t i = TRACE_HEADER_SIZE; i + 1 < trace.size(); i += 2) {
+    uint8_t source = (uint8_t)trace[i] >> 6;
+    if (source == TRACE_WAIT) {
+      at_ms += ((uint8_t)trace[i] & TRACE_SHORT_DELAY) << 8 | (uint8_t)trace[i + 1];
+      continue;
+    }
+    at_ms += (uint8_t)trace[i] & TRACE_SHORT_DELAY;
+    if (source == TRACE_IR) {
+      if (ir.size() < 2) {
+        ir_ms[ir.size()] = at_ms;
+      }
+      ir.push_back(trace[i + 1]);
+    } else {
+      if (sonar.empty()) {
+        first_sonar_ms = at_ms;
+      }
+      last_sonar_ms = at_ms;
+      sonar.push_back(trace[i + 1]);
+    }
+  }
+
+  // Every byte that came in (the sonar is read by Program0, from when it starts),
+  // the IR codes within a millisecond of arriving
+  printf("%zu IR bytes, %zu sonar bytes, %lu - %lums\n", ir.size(), sonar.size(),
+      first_sonar_ms, last_sonar_ms);
+  CHECK_EQ(ir.size(), 2);
+  CHECK_EQ(ir[0], IR_SELECT);
+  CHECK(ir_ms[0] >= 2000 && ir_ms[0] <= 2001);
+  CHECK_EQ(ir[1], IR_SELECT);
+  CHECK(ir_ms[1] >= 3000 && ir_ms[1] <= 3001);
+
+  CHECK_EQ(sonar.size() % 6, 0);
+  CHECK(!sonar.compare(0, 6, "R0700\r"));
+  CHECK(first_sonar_ms < ir_ms[0]);
+  CHECK(last_sonar_ms < RANGE_END_MS && last_sonar_ms + 150 >= RANGE_END_MS);
+}
+
+static void replay(const std::string &recorded) {
+  char path[] = "/tmp/test_trace_XXXXXX";
+  int fd = mkstemp(path);
+  CHECK(fd >= 0);
+  FILE *f = fdopen(fd, "w");
+  fputs(recorded.c_str(), f);
+  fclose(f);
+
+  Scenario scenario;
+  CHECK(scenario.replay_trace(path) > 0);
+  scenario.console(TRACE_MS, "trace");
+  scenario.start();
+  scenario.run_until(END_MS);
+  unlink(path);
+
+  CHECK(trace_lines(Serial.output) == recorded);
+}
+
+static void long_gap() {
+  Scenario scenario;
+  scenario.start();
+  tracer.record(TRACE_IR, IR_A);
+  uint16_t before = tracer.get_events();
+
+  // Longer than the ring holds in waits, then an event: the trace is just that event
+  sim::advance_ms((unsigned long)TRACE_LONG_DELAY * TRACE_BUFFER_SIZE);
+  tracer.record(TRACE_IR, IR_B);
+  CHECK_EQ(tracer.get_events(), 1);
+  CHECK_EQ(tracer.get_dropped(), before);
+
+  // A shorter one is still waited out, in 3 waits
+  sim::advance_ms(3 * (unsigned long)TRACE_LONG_DELAY);
+  tracer.record(TRACE_IR, IR_C);
+  CHECK_EQ(tracer.get_events(), 5);
+}
+
+int main() {
+  std::string recorded = record();
+  check_recording(recorded);
+  replay(recorded);
+  long_gap();
+  return CHECK_RESULT();
+}
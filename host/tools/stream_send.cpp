@@ -0,0 +1,176 @@
+/*
+ * stream_send.cpp
+ *
+ * stream_send: stream the test pattern (see FrameSender.h) to the bookshelf
+ * over its USB serial port, to try the stream program out from a PC.
+ *
+ *   stream_send [options] DEVICE
+ *
+ *   --fps N          Frames a second (default 60)
+ *   --seconds N      How long to stream for (default 30)
+ *   --fade MS        Fade time sent with each frame (default a frame and a half)
+ *   --wait MS        Time the board takes to restart when the port is opened (default 2000)
+ *
+ * It types "stream" on the console, sends the frames at a steady rate and
+ * then a stop frame, which puts the board back in the program it was in.
+ * DEVICE "-" writes it all to stdout instead, without the waits.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "FrameStream.h"
+#include "FrameSender.h"
+
+static void usage() {
+  fprintf(stderr, "usage: stream_send [--fps N] [--seconds N] [--fade MS] [--wait MS] DEVICE\n");
+  exit(2);
+}
+
+// Open the port raw at 115200 baud
+static int open_port(const char *path) {
+  int fd = open(path, O_RDWR | O_NOCTTY);
+  if (fd < 0) {
+    return -1;
+  }
+
+  struct termios tio;
+  if (tcgetattr(fd, &tio) < 0) {
+    close(fd);
+    return -1;
+  }
+  cfmakeraw(&tio);
+  cfsetispeed(&tio, B115200);
+  cfsetospeed(&tio, B115200);
+  tio.c_cflag |= CLOCAL | CREAD;
+  if (tcsetattr(fd, TCSANOW, &tio) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static bool send_all(int fd, const uint8_t *data, size_t size) {
+  while (size) {
+    ssize_t n = write(fd, data, size);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Sleep until a point on the monotonic clock
+static void sleep_until(uint64_t ns) {
+  struct timespec ts = { (time_t)(ns / 1000000000ULL), (long)(ns % 1000000000ULL) };
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+  }
+}
+
+int main(int argc, char **argv) {
+  unsigned int fps = 60;
+  unsigned long seconds = 30;
+  long fade_ms = -1;
+  unsigned long wait_ms = 2000;
+  const char *device = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+    if (!strcmp(arg, "--fps") && val) {
+      fps = strtoul(val, NULL, 10);
+      i++;
+    } else if (!strcmp(arg, "--seconds") && val) {
+      seconds = strtoul(val, NULL, 10);
+      i++;
+    } else if (!strcmp(arg, "--fade") && val) {
+      fade_ms = strtol(val, NULL, 10);
+      i++;
+    } else if (!strcmp(arg, "--wait") && val) {
+      wait_ms = strtoul(val, NULL, 10);
+      i++;
+    } else if (arg[0] != '-' || !strcmp(arg, "-")) {
+      device = arg;
+    } else {
+      usage();
+    }
+  }
+  if (!device || !fps || fade_ms > 0xFFFF) {
+    usage();
+  }
+  if (fade_ms < 0) {
+    fade_ms = 1500 / fps;
+  }
+
+  bool to_stdout = !strcmp(device, "-");
+  int fd = to_stdout ? STDOUT_FILENO : open_port(device);
+  if (fd < 0) {
+    fprintf(stderr, "can't open %s: %s\n", device, strerror(errno));
+    return 1;
+  }
+
+  // Opening the port restarts the board; give it time to come up before the command
+  if (!to_stdout) {
+    usleep(wait_ms * 1000);
+  }
+  const char command[] = "stream\n";
+  if (!send_all(fd, (const uint8_t *)command, strlen(command))) {
+    fprintf(stderr, "can't write to %s: %s\n", device, strerror(errno));
+    return 1;
+  }
+  if (!to_stdout) {
+    usleep(100000);
+  }
+
+  uint8_t values[STREAM_VALUES];
+  uint8_t frame[FRAME_SENDER_MAX];
+  unsigned long frames = (unsigned long)seconds * fps;
+  uint64_t start = now_ns();
+  unsigned long behind = 0;
+
+  for (unsigned long n = 0; n < frames; n++) {
+    uint64_t due = start + (uint64_t)n * 1000000000ULL / fps;
+    if (!to_stdout) {
+      if (now_ns() > due + 1000000000ULL / fps) {
+        behind++;
+      }
+      sleep_until(due);
+    }
+
+    pattern_frame(n, fps, values);
+    size_t size = encode_frame(values, fade_ms, frame);
+    if (!send_all(fd, frame, size)) {
+      fprintf(stderr, "can't write to %s: %s\n", device, strerror(errno));
+      return 1;
+    }
+  }
+
+  size_t size = encode_stop(frame);
+  if (!send_all(fd, frame, size)) {
+    fprintf(stderr, "can't write to %s: %s\n", device, strerror(errno));
+    return 1;
+  }
+  if (!to_stdout) {
+    tcdrain(fd);
+    close(fd);
+  }
+
+  fprintf(stderr, "%lu frames at %u fps, %lu sent more than a frame late\n", frames, fps, behind);
+  return 0;
+}